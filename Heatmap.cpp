@@ -1,13 +1,16 @@
 #include "stdafx.h"
 #include "Heatmap.h"
+#include <cfloat>
 #include <Engine/Source/AI/HeatmapSystem/HeatmapCommonData.h>
 #include <Engine/Source/Graphics/DebugRenderer.h>
 #include <Engine/Source/AI/HeatmapSystem/HeatmapManager.h>
+#include <Engine/Source/AI/HeatmapSystem/HeatmapSimd.h>
+#include <Engine/Source/AI/HeatmapSystem/SeparableKernel.h>
 
 namespace AI
 {
 	Heatmap::Heatmap(HeatmapManager* aManager) : 
-		myManager(aManager), myValidCells(&aManager->myValidCells), myMutex() 
+		myManager(aManager), myValidCells(&aManager->myValidCells)
 	{
 	
 	}
@@ -19,58 +22,924 @@ namespace AI
 		myMin = aMin;
 		myMax = aMax;
 		myCellSize = aCellSize;
-		myValues.resize(aGridSize.x * aGridSize.y);
+		myStaticValues.clear();
+		myLevelValues = nullptr;
 
-		int halfSize = myGridSize.x / 2;
-		myBoundsMin.x = abs(std::min(0, myWorldOrigin.x - halfSize));
-		myBoundsMin.y = abs(std::min(0, myWorldOrigin.y - halfSize));
-		myBoundsMax.x = std::min(myManager->myGridSize.x, myWorldOrigin.x + halfSize);
-		myBoundsMax.y = std::min(myManager->myGridSize.y, myWorldOrigin.y + halfSize);
+		// Inclusive, the fills index the valid cells with these unchecked.
+		Vector2i halfSize = { myGridSize.x / 2, myGridSize.y / 2 };
+		myBoundsMin.x = abs(std::min(0, myWorldOrigin.x - halfSize.x));
+		myBoundsMin.y = abs(std::min(0, myWorldOrigin.y - halfSize.y));
+		myBoundsMax.x = std::min(std::min(myGridSize.x, myManager->myGridSize.x) - 1, myWorldOrigin.x + halfSize.x);
+		myBoundsMax.y = std::min(std::min(myGridSize.y, myManager->myGridSize.y) - 1, myWorldOrigin.y + halfSize.y);
+
+		myTileCount = { (myGridSize.x + TileSize - 1) / TileSize, (myGridSize.y + TileSize - 1) / TileSize };
+		myTileMutexes = std::make_unique<std::mutex[]>(myTileCount.x * myTileCount.y);
+		myDirtyTiles.assign(myTileCount.x * myTileCount.y, 0);
+		myTileVersions.assign(myTileCount.x * myTileCount.y, 1);
+
+		if (mySparse)
+		{
+			myValues.clear();
+			myTiles.clear();
+			myTiles.resize(myTileCount.x * myTileCount.y);
+		}
+		else
+		{
+			myValues.resize(aGridSize.x * aGridSize.y);
+		}
+
+		myPublished.reset();
+		myRecycled.reset();
+		Publish();
+	}
+
+	void Heatmap::Publish()
+	{
+		if (myPublished && std::none_of(myDirtyTiles.begin(), myDirtyTiles.end(), [](unsigned char aDirty) { return aDirty != 0; }))
+		{
+			return;
+		}
+
+		// Reuse the snapshot from two publishes ago unless a reader still holds it.
+		// A snapshot laid out for other storage, from before SetSparse or SetQuantization, is never reused.
+		const float quantizeStep = mySparse ? 0.0f : myQuantizeStep;
+		std::shared_ptr<HeatmapSnapshot> snapshot = std::move(myRecycled);
+		if (!snapshot || snapshot.use_count() > 1 || snapshot->IsSparse() != mySparse || snapshot->quantizeStep != quantizeStep)
+		{
+			snapshot = std::make_shared<HeatmapSnapshot>();
+			snapshot->width = myGridSize.x;
+			snapshot->tileColumns = myTileCount.x;
+			snapshot->quantizeStep = quantizeStep;
+			snapshot->tileVersions.assign(myTileVersions.size(), 0);
+
+			if (mySparse) snapshot->tiles.resize(myTileVersions.size());
+			else if (quantizeStep > 0.0f) snapshot->quantized.resize(myGridSize.x * myGridSize.y);
+			else snapshot->values.resize(myGridSize.x * myGridSize.y);
+		}
+
+		myChangedTiles.clear();
+
+		for (int tileY = 0; tileY < myTileCount.y; tileY++)
+		{
+			for (int tileX = 0; tileX < myTileCount.x; tileX++)
+			{
+				int tile = tileY * myTileCount.x + tileX;
+				if (snapshot->tileVersions[tile] == myTileVersions[tile]) continue;
+
+				myChangedTiles.push_back(tile);
+				snapshot->tileVersions[tile] = myTileVersions[tile];
+
+				if (mySparse)
+				{
+					PublishSparseTile(*snapshot, tile);
+					continue;
+				}
+
+				int colBegin = tileX * TileSize;
+				int colEnd = std::min(myGridSize.x, colBegin + TileSize);
+				int rowEnd = std::min(myGridSize.y, (tileY + 1) * TileSize);
+
+				for (int row = tileY * TileSize; row < rowEnd; row++)
+				{
+					int index = row * myGridSize.x + colBegin;
+
+					if (snapshot->IsQuantized())
+					{
+						const float* source = myValues.data() + index;
+						if (HasStaticBase())
+						{
+							myPublishRow.assign(source, source + (colEnd - colBegin));
+							AddStaticBase(myPublishRow.data(), index, colEnd - colBegin);
+							source = myPublishRow.data();
+						}
+
+						simd::Quantize(source, myInvQuantizeStep, snapshot->quantized.data() + index, colEnd - colBegin);
+						continue;
+					}
+
+					std::copy(myValues.begin() + index, myValues.begin() + index + (colEnd - colBegin), snapshot->values.begin() + index);
+
+					AddStaticBase(snapshot->values.data() + index, index, colEnd - colBegin);
+				}
+			}
+		}
+
+		if (myRegionQueries)
+		{
+			UpdateRegionData(*snapshot, myChangedTiles);
+		}
+
+		snapshot->version = ++myVersion;
+		ClearDirtyTiles();
+
+		std::shared_ptr<const HeatmapSnapshot> previous = std::atomic_exchange(&myPublished, std::shared_ptr<const HeatmapSnapshot>(snapshot));
+		myRecycled = std::const_pointer_cast<HeatmapSnapshot>(previous);
+	}
+
+	void Heatmap::PublishSparseTile(HeatmapSnapshot& aSnapshot, const int aTile)
+	{
+		std::unique_ptr<float[]>& source = myTiles[aTile];
+		if (source && std::all_of(source.get(), source.get() + TileSize * TileSize, [this](float aValue) { return std::abs(aValue) <= mySparseZero; }))
+		{
+			source.reset();
+		}
+
+		std::unique_ptr<float[]>& target = aSnapshot.tiles[aTile];
+		if (!source && !HasStaticBase())
+		{
+			target.reset();
+			return;
+		}
+
+		if (!target) target = std::make_unique<float[]>(TileSize * TileSize);
+
+		if (source) std::copy(source.get(), source.get() + TileSize * TileSize, target.get());
+		else std::fill(target.get(), target.get() + TileSize * TileSize, 0.0f);
+
+		if (!HasStaticBase()) return;
+
+		int colBegin = (aTile % myTileCount.x) * TileSize;
+		int rowBegin = (aTile / myTileCount.x) * TileSize;
+		int colEnd = std::min(myGridSize.x, colBegin + TileSize);
+		int rowEnd = std::min(myGridSize.y, rowBegin + TileSize);
+
+		for (int row = rowBegin; row < rowEnd; row++)
+		{
+			AddStaticBase(target.get() + (row - rowBegin) * TileSize, row * myGridSize.x + colBegin, colEnd - colBegin);
+		}
+	}
+
+	void Heatmap::AddStaticBase(float* aValues, const int aIndex, const int aCount) const
+	{
+		if (myLevelValues) simd::AddScaled(aValues, myLevelValues + aIndex, 1.0f, aCount);
+		if (!myStaticValues.empty()) simd::AddScaled(aValues, myStaticValues.data() + aIndex, 1.0f, aCount);
+	}
+
+	void Heatmap::SetSparse(const bool aSparse)
+	{
+		if (aSparse == mySparse) return;
+
+		// Not initialized yet, Init allocates the right storage.
+		if (!myTileMutexes)
+		{
+			mySparse = aSparse;
+			return;
+		}
+
+		TileWriteScope scope(*this, { 0, 0 }, { myGridSize.x - 1, myGridSize.y - 1 });
+
+		if (aSparse)
+		{
+			myTiles.clear();
+			myTiles.resize(myTileCount.x * myTileCount.y);
+		}
+		else
+		{
+			myValues.assign(myGridSize.x * myGridSize.y, 0.0f);
+		}
+
+		for (int tile = 0; tile < myTileCount.x * myTileCount.y; tile++)
+		{
+			int colBegin = (tile % myTileCount.x) * TileSize;
+			int rowBegin = (tile / myTileCount.x) * TileSize;
+			int colEnd = std::min(myGridSize.x, colBegin + TileSize);
+			int rowEnd = std::min(myGridSize.y, rowBegin + TileSize);
+
+			for (int row = rowBegin; row < rowEnd; row++)
+			{
+				if (aSparse)
+				{
+					const float* values = myValues.data() + row * myGridSize.x + colBegin;
+					if (std::all_of(values, values + (colEnd - colBegin), [](float aValue) { return aValue == 0.0f; })) continue;
+
+					std::copy(values, values + (colEnd - colBegin), GetTile(tile) + (row - rowBegin) * TileSize);
+				}
+				else if (myTiles[tile])
+				{
+					const float* values = myTiles[tile].get() + (row - rowBegin) * TileSize;
+					std::copy(values, values + (colEnd - colBegin), myValues.begin() + row * myGridSize.x + colBegin);
+				}
+			}
+		}
+
+		if (aSparse)
+		{
+			myValues.clear();
+			myValues.shrink_to_fit();
+		}
+		else
+		{
+			myTiles.clear();
+			myTiles.shrink_to_fit();
+		}
+
+		mySparse = aSparse;
+	}
+
+	void Heatmap::SetQuantization(const float aStep, const std::vector<Footprint*>& aFootprints)
+	{
+		const float step = aStep > 0.0f ? std::exp2(std::round(std::log2(aStep))) : 0.0f;
+		if (step == myQuantizeStep) return;
+
+		// Not initialized yet, nothing is painted and nobody paints.
+		if (!myTileMutexes)
+		{
+			myQuantizeStep = step;
+			myInvQuantizeStep = step > 0.0f ? 1.0f / step : 0.0f;
+			return;
+		}
+
+		TileWriteScope scope(*this, { 0, 0 }, { myGridSize.x - 1, myGridSize.y - 1 });
+		myQuantizeStep = step;
+		myInvQuantizeStep = step > 0.0f ? 1.0f / step : 0.0f;
+
+		// What is painted already is rounded once, everything painted from here on cancels exactly. Rounding a sum
+		// is not the sum of the rounded footprints, so the footprints come out first and go back in rounded.
+		if (step <= 0.0f) return;
+		for (const Footprint* footprint : aFootprints) AddFootprint(*footprint, -1.0f);
+
+		for (float& value : myValues) value = Quantize(value);
+		for (auto& tile : myTiles)
+		{
+			if (!tile) continue;
+			for (int cell = 0; cell < TileSize * TileSize; cell++) tile[cell] = Quantize(tile[cell]);
+		}
+
+		for (Footprint* footprint : aFootprints)
+		{
+			for (float& value : footprint->values) value = Quantize(value);
+			AddFootprint(*footprint, 1.0f);
+		}
+	}
+
+	unsigned long long Heatmap::GetWindowVersion(const HeatmapSnapshot& aSnapshot, const Vector2i& aCellMin, const Vector2i& aCellMax) const
+	{
+		Vector2i tileMin, tileMax;
+		if (!GetTileRange(aCellMin, aCellMax, tileMin, tileMax)) return aSnapshot.version;
+
+		unsigned long long version = 0;
+		for (int y = tileMin.y; y <= tileMax.y; y++)
+		{
+			for (int x = tileMin.x; x <= tileMax.x; x++)
+			{
+				version += aSnapshot.tileVersions[y * myTileCount.x + x];
+			}
+		}
+
+		return version;
+	}
+
+#pragma region Region Queries
+
+	void Heatmap::SetRegionQueries(const bool aEnabled)
+	{
+		myRegionQueries = aEnabled;
+
+		// The next publish rebuilds the region data of whichever snapshot it writes to.
+		if (myRegionQueries)
+		{
+			std::fill(myDirtyTiles.begin(), myDirtyTiles.end(), 1);
+		}
+	}
+
+	void Heatmap::UpdateRegionData(HeatmapSnapshot& aSnapshot, const std::vector<int>& aChangedTiles) const
+	{
+		const int stride = myGridSize.x + 1;
+		bool rebuild = aSnapshot.summedArea.size() != static_cast<size_t>(stride * (myGridSize.y + 1));
+
+		Vector2i firstCell = { 0, 0 };
+		if (rebuild)
+		{
+			aSnapshot.summedArea.assign(stride * (myGridSize.y + 1), 0.0);
+			aSnapshot.maxPyramid.clear();
+			aSnapshot.minPyramid.clear();
+
+			for (int level = 0; ; level++)
+			{
+				Vector2i size = GetPyramidSize(level);
+				aSnapshot.maxPyramid.emplace_back(size.x * size.y, 0.0f);
+				aSnapshot.minPyramid.emplace_back(size.x * size.y, 0.0f);
+				if (size.x == 1 && size.y == 1) break;
+			}
+		}
+		else if (!aChangedTiles.empty())
+		{
+			firstCell = { INT_MAX, INT_MAX };
+			for (int tile : aChangedTiles)
+			{
+				firstCell.x = std::min(firstCell.x, (tile % myTileCount.x) * TileSize);
+				firstCell.y = std::min(firstCell.y, (tile / myTileCount.x) * TileSize);
+			}
+		}
+		else
+		{
+			return;
+		}
+
+		// Tile min/max of every copied tile, or of every tile on a rebuild.
+		auto updateTile = [&](const int aTile)
+		{
+			int colBegin = (aTile % myTileCount.x) * TileSize;
+			int rowBegin = (aTile / myTileCount.x) * TileSize;
+			int colEnd = std::min(myGridSize.x, colBegin + TileSize);
+			int rowEnd = std::min(myGridSize.y, rowBegin + TileSize);
+
+			float highest = -FLT_MAX;
+			float lowest = FLT_MAX;
+			for (int row = rowBegin; row < rowEnd; row++)
+			{
+				for (int col = colBegin; col < colEnd; col++)
+				{
+					float value = aSnapshot.GetValue(row, col);
+					highest = std::max(highest, value);
+					lowest = std::min(lowest, value);
+				}
+			}
+
+			aSnapshot.maxPyramid[0][aTile] = highest;
+			aSnapshot.minPyramid[0][aTile] = lowest;
+		};
+
+		if (rebuild)
+		{
+			for (int tile = 0; tile < myTileCount.x * myTileCount.y; tile++) updateTile(tile);
+		}
+		else
+		{
+			for (int tile : aChangedTiles) updateTile(tile);
+		}
+
+		// The levels above are tiny next to the map, they are rebuilt whole.
+		for (int level = 1; level < static_cast<int>(aSnapshot.maxPyramid.size()); level++)
+		{
+			Vector2i size = GetPyramidSize(level);
+			Vector2i childSize = GetPyramidSize(level - 1);
+
+			for (int y = 0; y < size.y; y++)
+			{
+				for (int x = 0; x < size.x; x++)
+				{
+					float highest = -FLT_MAX;
+					float lowest = FLT_MAX;
+					for (int child = 0; child < 4; child++)
+					{
+						int childX = x * 2 + (child & 1);
+						int childY = y * 2 + (child >> 1);
+						if (childX >= childSize.x || childY >= childSize.y) continue;
+
+						highest = std::max(highest, aSnapshot.maxPyramid[level - 1][childY * childSize.x + childX]);
+						lowest = std::min(lowest, aSnapshot.minPyramid[level - 1][childY * childSize.x + childX]);
+					}
+
+					aSnapshot.maxPyramid[level][y * size.x + x] = highest;
+					aSnapshot.minPyramid[level][y * size.x + x] = lowest;
+				}
+			}
+		}
+
+		// A changed cell only moves the sums below and to the right of it, everything above or left of the first
+		// changed tile is still valid and seeds the recurrence.
+		double* sums = aSnapshot.summedArea.data();
+		for (int row = firstCell.y; row < myGridSize.y; row++)
+		{
+			for (int col = firstCell.x; col < myGridSize.x; col++)
+			{
+				int index = (row + 1) * stride + (col + 1);
+				sums[index] = aSnapshot.GetValue(row, col) + sums[index - stride] + sums[index - 1] - sums[index - stride - 1];
+			}
+		}
+	}
+
+	double Heatmap::GetRegionSum(const HeatmapSnapshot& aSnapshot, const Vector2i& aCellMin, const Vector2i& aCellMax) const
+	{
+		Vector2i cellMin = { std::max(0, aCellMin.x), std::max(0, aCellMin.y) };
+		Vector2i cellMax = { std::min(myGridSize.x - 1, aCellMax.x), std::min(myGridSize.y - 1, aCellMax.y) };
+		if (cellMin.x > cellMax.x || cellMin.y > cellMax.y) return 0.0;
+
+		if (aSnapshot.summedArea.empty())
+		{
+			double sum = 0.0;
+			for (int row = cellMin.y; row <= cellMax.y; row++)
+			{
+				for (int col = cellMin.x; col <= cellMax.x; col++)
+				{
+					sum += aSnapshot.GetValue(row, col);
+				}
+			}
+			return sum;
+		}
+
+		const int stride = myGridSize.x + 1;
+		const std::vector<double>& sums = aSnapshot.summedArea;
+
+		return sums[(cellMax.y + 1) * stride + (cellMax.x + 1)]
+			- sums[cellMin.y * stride + (cellMax.x + 1)]
+			- sums[(cellMax.y + 1) * stride + cellMin.x]
+			+ sums[cellMin.y * stride + cellMin.x];
+	}
+
+	float Heatmap::GetRegionMax(const HeatmapSnapshot& aSnapshot, const Vector2i& aCellMin, const Vector2i& aCellMax) const
+	{
+		Vector2i cellMin = { std::max(0, aCellMin.x), std::max(0, aCellMin.y) };
+		Vector2i cellMax = { std::min(myGridSize.x - 1, aCellMax.x), std::min(myGridSize.y - 1, aCellMax.y) };
+		float best = -FLT_MAX;
+		if (cellMin.x > cellMax.x || cellMin.y > cellMax.y) return best;
+
+		if (aSnapshot.maxPyramid.empty())
+		{
+			for (int row = cellMin.y; row <= cellMax.y; row++)
+			{
+				for (int col = cellMin.x; col <= cellMax.x; col++)
+				{
+					best = std::max(best, aSnapshot.GetValue(row, col));
+				}
+			}
+			return best;
+		}
+
+		VisitRegionMax(aSnapshot, static_cast<int>(aSnapshot.maxPyramid.size()) - 1, { 0, 0 }, cellMin, cellMax, best);
+		return best;
+	}
+
+	void Heatmap::VisitRegionMax(const HeatmapSnapshot& aSnapshot, const int aLevel, const Vector2i& aNode, const Vector2i& aCellMin, const Vector2i& aCellMax, float& aBest) const
+	{
+		Vector2i size = GetPyramidSize(aLevel);
+		if (aNode.x >= size.x || aNode.y >= size.y) return;
+
+		// Nodes that can't beat the current best are skipped without looking inside.
+		float nodeHighest = aSnapshot.maxPyramid[aLevel][aNode.y * size.x + aNode.x];
+		if (nodeHighest <= aBest) return;
+
+		int span = TileSize << aLevel;
+		Vector2i nodeMin = { aNode.x * span, aNode.y * span };
+		Vector2i nodeMax = { std::min(myGridSize.x, nodeMin.x + span) - 1, std::min(myGridSize.y, nodeMin.y + span) - 1 };
+
+		if (nodeMax.x < aCellMin.x || nodeMin.x > aCellMax.x || nodeMax.y < aCellMin.y || nodeMin.y > aCellMax.y) return;
+
+		if (nodeMin.x >= aCellMin.x && nodeMax.x <= aCellMax.x && nodeMin.y >= aCellMin.y && nodeMax.y <= aCellMax.y)
+		{
+			aBest = nodeHighest;
+			return;
+		}
+
+		if (aLevel == 0)
+		{
+			for (int row = std::max(nodeMin.y, aCellMin.y); row <= std::min(nodeMax.y, aCellMax.y); row++)
+			{
+				for (int col = std::max(nodeMin.x, aCellMin.x); col <= std::min(nodeMax.x, aCellMax.x); col++)
+				{
+					aBest = std::max(aBest, aSnapshot.GetValue(row, col));
+				}
+			}
+			return;
+		}
+
+		for (int child = 0; child < 4; child++)
+		{
+			VisitRegionMax(aSnapshot, aLevel - 1, { aNode.x * 2 + (child & 1), aNode.y * 2 + (child >> 1) }, aCellMin, aCellMax, aBest);
+		}
+	}
+
+#pragma endregion
+
+	void Heatmap::Clear()
+	{
+		TileWriteScope scope(*this, { 0, 0 }, { myGridSize.x - 1, myGridSize.y - 1 });
+		std::fill(myValues.begin(), myValues.end(), 0.0f);
+		for (auto& tile : myTiles) tile.reset();
+		std::fill(myStaticValues.begin(), myStaticValues.end(), 0.0f);
+	}
+
+	void Heatmap::LockTiles(const Vector2i& aCellMin, const Vector2i& aCellMax)
+	{
+		Vector2i tileMin, tileMax;
+		if (!GetTileRange(aCellMin, aCellMax, tileMin, tileMax)) return;
+
+		for (int y = tileMin.y; y <= tileMax.y; y++)
+		{
+			for (int x = tileMin.x; x <= tileMax.x; x++)
+			{
+				myTileMutexes[y * myTileCount.x + x].lock();
+			}
+		}
+	}
+
+	void Heatmap::UnlockTiles(const Vector2i& aCellMin, const Vector2i& aCellMax)
+	{
+		Vector2i tileMin, tileMax;
+		if (!GetTileRange(aCellMin, aCellMax, tileMin, tileMax)) return;
+
+		for (int y = tileMin.y; y <= tileMax.y; y++)
+		{
+			for (int x = tileMin.x; x <= tileMax.x; x++)
+			{
+				myTileMutexes[y * myTileCount.x + x].unlock();
+			}
+		}
+	}
+
+	void Heatmap::MarkTilesDirty(const Vector2i& aCellMin, const Vector2i& aCellMax)
+	{
+		Vector2i tileMin, tileMax;
+		if (!GetTileRange(aCellMin, aCellMax, tileMin, tileMax)) return;
+
+		for (int y = tileMin.y; y <= tileMax.y; y++)
+		{
+			for (int x = tileMin.x; x <= tileMax.x; x++)
+			{
+				myDirtyTiles[y * myTileCount.x + x] = 1;
+				myTileVersions[y * myTileCount.x + x]++;
+			}
+		}
 	}
 
 	void Heatmap::FloodFillInfluence(const Vector2i& aOriginCoord, const InfluenceData& aData, float aAmount)
 	{
-		HeatTemplate& heatTemplate = myManager->GetImprintTemplate(aData);
-		FalloffFunction curveFunc = GetFalloffFunction(aData.type);
+		std::shared_ptr<const HeatTemplate> templateRef = myManager->GetImprintTemplate(aData);
+		const HeatTemplate& heatTemplate = *templateRef;
+		int radius = heatTemplate.dimensions / 2;
+
+		TileWriteScope scope(*this, aOriginCoord - Vector2i(radius, radius), aOriginCoord + Vector2i(radius, radius));
+
+		DispatchFalloff(heatTemplate.falloff, [&](auto aCurve) {
+			TraverseInfluence<decltype(aCurve)>(aOriginCoord, heatTemplate, aAmount, [this](int aIndex, const Vector2i& aCoord, float aValue) {
+				AddToCell(aIndex, aCoord, Quantize(aValue));
+			});
+		});
+	}
+
+	void Heatmap::ClearInfluence()
+	{
+		TileWriteScope scope(*this, { 0, 0 }, { myGridSize.x - 1, myGridSize.y - 1 });
+		std::fill(myValues.begin(), myValues.end(), 0.0f);
+		for (auto& tile : myTiles) tile.reset();
+	}
+
+	void Heatmap::ConvolveInfluence(const std::vector<float>& aImpulses, const SeparableKernel& aKernel)
+	{
+		TileWriteScope scope(*this, { 0, 0 }, { myGridSize.x - 1, myGridSize.y - 1 });
+
+		const int width = myGridSize.x;
+		const int height = myGridSize.y;
+		const int radius = aKernel.radius;
+
+		// Rows without impulses stay zero through the row pass, both passes skip them.
+		myImpulseRows.assign(height, 0);
+		bool anyImpulse = false;
+		for (int row = 0; row < height; row++)
+		{
+			const float* impulses = aImpulses.data() + row * width;
+			myImpulseRows[row] = std::any_of(impulses, impulses + width, [](float aValue) { return aValue != 0.0f; }) ? 1 : 0;
+			anyImpulse |= myImpulseRows[row] != 0;
+		}
+		if (!anyImpulse) return;
+
+		myConvolveRows.resize(width * height);
+
+		for (int term = 0; term < aKernel.GetTermCount(); term++)
+		{
+			const float* factor = aKernel.GetFactor(term);
+
+			// Rows: spread every impulse sideways.
+			for (int row = 0; row < height; row++)
+			{
+				if (!myImpulseRows[row]) continue;
+
+				float* spread = myConvolveRows.data() + row * width;
+				const float* impulses = aImpulses.data() + row * width;
+				std::fill(spread, spread + width, 0.0f);
+
+				for (int offset = -radius; offset <= radius; offset++)
+				{
+					int first = std::max(0, offset);
+					int last = std::min(width, width + offset);
+					if (first < last) simd::AddScaled(spread + first, impulses + first - offset, factor[radius + offset], last - first);
+				}
+			}
+
+			// Columns: spread the row results up and down into the values.
+			for (int row = 0; row < height; row++)
+			{
+				for (int offset = -radius; offset <= radius; offset++)
+				{
+					int source = row - offset;
+					if (source < 0 || source >= height || !myImpulseRows[source]) continue;
+
+					const float* spread = myConvolveRows.data() + source * width;
+					const float scale = aKernel.scales[term] * factor[radius + offset];
+					ForEachRowSegment(row, 0, width, [&](float* aValues, int aCol, int aCount) {
+						if (!aValues)
+						{
+							if (std::all_of(spread + aCol, spread + aCol + aCount, [](float aValue) { return aValue == 0.0f; })) return;
+							aValues = &GetCell(row * width + aCol, { aCol, row });
+						}
+						simd::AddScaled(aValues, spread + aCol, scale, aCount);
+					});
+				}
+			}
+		}
+
+		// Convolved layers are repainted from clear, rounding the result is enough to keep them on the steps.
+		if (myQuantizeStep <= 0.0f) return;
+		for (int row = 0; row < height; row++)
+		{
+			ForEachRowSegment(row, 0, width, [&](float* aValues, int, int aCount) {
+				if (!aValues) return;
+				for (int i = 0; i < aCount; i++) aValues[i] = Quantize(aValues[i]);
+			});
+		}
+	}
+
+	void Heatmap::MaskInvalidCells()
+	{
+		TileWriteScope scope(*this, { 0, 0 }, { myGridSize.x - 1, myGridSize.y - 1 });
+
+		for (size_t i = 0; i < myValues.size(); i++)
+		{
+			if (!(*myValidCells)[i]) myValues[i] = 0.0f;
+		}
+
+		for (int tile = 0; tile < static_cast<int>(myTiles.size()); tile++)
+		{
+			if (!myTiles[tile]) continue;
+
+			int colBegin = (tile % myTileCount.x) * TileSize;
+			int rowBegin = (tile / myTileCount.x) * TileSize;
+			int colEnd = std::min(myGridSize.x, colBegin + TileSize);
+			int rowEnd = std::min(myGridSize.y, rowBegin + TileSize);
+
+			for (int row = rowBegin; row < rowEnd; row++)
+			{
+				for (int col = colBegin; col < colEnd; col++)
+				{
+					if (!(*myValidCells)[row * myGridSize.x + col]) myTiles[tile][(row - rowBegin) * TileSize + (col - colBegin)] = 0.0f;
+				}
+			}
+		}
+	}
+
+	void Heatmap::ClearStatic()
+	{
+		if (myStaticValues.empty()) return;
+
+		TileWriteScope scope(*this, { 0, 0 }, { myGridSize.x - 1, myGridSize.y - 1 });
+		std::fill(myStaticValues.begin(), myStaticValues.end(), 0.0f);
+	}
+	void Heatmap::SetLevelStatic(const float* aValues)
+	{
+		TileWriteScope scope(*this, { 0, 0 }, { myGridSize.x - 1, myGridSize.y - 1 });
+		myLevelValues = aValues;
+	}
+
+	void Heatmap::BakeInfluence(const Vector2i& aOriginCoord, const InfluenceData& aData, float aAmount)
+	{
+		std::shared_ptr<const HeatTemplate> templateRef = myManager->GetImprintTemplate(aData);
+		const HeatTemplate& heatTemplate = *templateRef;
+		int radius = heatTemplate.dimensions / 2;
+
+		if (myStaticValues.empty())
+		{
+			myStaticValues.assign(myGridSize.x * myGridSize.y, 0.0f);
+		}
 
+		TileWriteScope scope(*this, aOriginCoord - Vector2i(radius, radius), aOriginCoord + Vector2i(radius, radius));
+
+		DispatchFalloff(heatTemplate.falloff, [&](auto aCurve) {
+			TraverseInfluence<decltype(aCurve)>(aOriginCoord, heatTemplate, aAmount, [this](int aIndex, const Vector2i&, float aValue) {
+				myStaticValues[aIndex] += aValue;
+			});
+		});
+	}
+
+	void Heatmap::PaintInfluence(const Vector2i& aOriginCoord, const InfluenceData& aData, float aAmount, Footprint& aOutFootprint)
+	{
+		std::shared_ptr<const HeatTemplate> templateRef = myManager->GetImprintTemplate(aData);
+		const HeatTemplate& heatTemplate = *templateRef;
 		int radius = heatTemplate.dimensions / 2;
+
+		Vector2i boundsMin = { std::max(myBoundsMin.x, aOriginCoord.x - radius), std::max(myBoundsMin.y, aOriginCoord.y - radius) };
+		Vector2i boundsMax = { std::min(myBoundsMax.x, aOriginCoord.x + radius), std::min(myBoundsMax.y, aOriginCoord.y + radius) };
+		Vector2i size = { boundsMax.x - boundsMin.x + 1, boundsMax.y - boundsMin.y + 1 };
+
+		aOutFootprint.Clear();
+		aOutFootprint.recorded = true;
+		aOutFootprint.cellMin = boundsMin;
+		aOutFootprint.cellMax = boundsMax;
+
+		TileWriteScope scope(*this, aOriginCoord - Vector2i(radius, radius), aOriginCoord + Vector2i(radius, radius));
+
+		FloodFillScratch& scratch = HeatmapManager::GetFloodFillScratch();
+		if (size.x > 0 && size.y > 0)
+		{
+			scratch.BeginWindow(boundsMin, size);
+		}
+
+		DispatchFalloff(heatTemplate.falloff, [&](auto aCurve) {
+			TraverseInfluence<decltype(aCurve)>(aOriginCoord, heatTemplate, aAmount, [&](int aIndex, const Vector2i& aCoord, float aValue) {
+				aValue = Quantize(aValue);
+				AddToCell(aIndex, aCoord, aValue);
+				if (scratch.InWindow(aCoord)) scratch.WindowAt(aCoord) = aValue;
+			});
+		});
+
+		if (size.x <= 0 || size.y <= 0) return;
+
+		// The fill visits cells in BFS order, the window turns them back into row-major runs.
+		for (int row = 0; row < size.y; row++)
+		{
+			const float* written = scratch.WindowRow(row);
+			int rowIndex = (boundsMin.y + row) * myGridSize.x + boundsMin.x;
+
+			for (int col = 0; col < size.x; col++)
+			{
+				if (written[col] == 0.0f) continue;
+
+				Footprint::Run* run = aOutFootprint.runs.empty() ? nullptr : &aOutFootprint.runs.back();
+				if (run && run->index + run->length == rowIndex + col && col != 0)
+				{
+					run->length++;
+				}
+				else
+				{
+					aOutFootprint.runs.push_back({ rowIndex + col, 1 });
+				}
+
+				aOutFootprint.values.push_back(written[col]);
+			}
+		}
+	}
+
+	void Heatmap::EraseFootprint(Footprint& aFootprint)
+	{
+		if (!aFootprint.runs.empty())
+		{
+			TileWriteScope scope(*this, aFootprint.cellMin, aFootprint.cellMax);
+			AddFootprint(aFootprint, -1.0f);
+		}
+
+		aFootprint.Clear();
+	}
+
+	void Heatmap::AddFootprint(const Footprint& aFootprint, const float aScale)
+	{
+		const float* values = aFootprint.values.data();
+		for (const Footprint::Run& run : aFootprint.runs)
+		{
+			int row = run.index / myGridSize.x;
+			int col = run.index - row * myGridSize.x;
+
+			// A missing tile was freed once it was back to zero, there is nothing left of the imprint to take out.
+			ForEachRowSegment(row, col, col + run.length, [&](float* aValues, int aCol, int aCount) {
+				if (!aValues)
+				{
+					if (aScale < 0.0f) return;
+					aValues = &GetCell(row * myGridSize.x + aCol, { aCol, row });
+				}
+				simd::AddScaled(aValues, values + (aCol - col), aScale, aCount);
+			});
+			values += run.length;
+		}
+	}
+
+	void Heatmap::MoveInfluence(const Vector2i& aFromCoord, const Vector2i& aToCoord, const InfluenceData& aData, float aAmount, Footprint* aFootprint)
+	{
+		if (aFromCoord == aToCoord) return;
+
+		// No flood fill for the old imprint at all, only the new one is traversed.
+		if (aFootprint)
+		{
+			if (aFootprint->recorded) EraseFootprint(*aFootprint);
+			else FloodFillInfluence(aFromCoord, aData, -aAmount);
+
+			PaintInfluence(aToCoord, aData, aAmount, *aFootprint);
+			return;
+		}
+
+		std::shared_ptr<const HeatTemplate> templateRef = myManager->GetImprintTemplate(aData);
+		const HeatTemplate& heatTemplate = *templateRef;
+		int radius = heatTemplate.dimensions / 2;
+
+		Vector2i boundsMin = {
+			std::max(myBoundsMin.x, std::min(aFromCoord.x, aToCoord.x) - radius),
+			std::max(myBoundsMin.y, std::min(aFromCoord.y, aToCoord.y) - radius) };
+		Vector2i boundsMax = {
+			std::min(myBoundsMax.x, std::max(aFromCoord.x, aToCoord.x) + radius),
+			std::min(myBoundsMax.y, std::max(aFromCoord.y, aToCoord.y) + radius) };
+		Vector2i size = { boundsMax.x - boundsMin.x + 1, boundsMax.y - boundsMin.y + 1 };
+
+		// Far jumps barely overlap, two separate fills touch less memory than the union box.
+		if (size.x <= 0 || size.y <= 0 || size.x * size.y > 2 * heatTemplate.dimensions * heatTemplate.dimensions)
+		{
+			FloodFillInfluence(aFromCoord, aData, -aAmount);
+			FloodFillInfluence(aToCoord, aData, aAmount);
+			return;
+		}
+
+		TileWriteScope scope(*this, boundsMin, boundsMax);
+
+		FloodFillScratch& scratch = HeatmapManager::GetFloodFillScratch();
+		scratch.BeginWindow(boundsMin, size);
+
+		DispatchFalloff(heatTemplate.falloff, [&](auto aCurve) {
+			auto accumulate = [&](int aIndex, const Vector2i& aCoord, float aValue) {
+				aValue = Quantize(aValue);
+				if (scratch.InWindow(aCoord)) scratch.WindowAt(aCoord) += aValue;
+				else AddToCell(aIndex, aCoord, aValue);
+			};
+
+			TraverseInfluence<decltype(aCurve)>(aFromCoord, heatTemplate, -aAmount, accumulate);
+			TraverseInfluence<decltype(aCurve)>(aToCoord, heatTemplate, aAmount, accumulate);
+		});
+
+		// Write the combined delta row by row, leaving cells where both imprints cancel untouched.
+		for (int row = 0; row < size.y; row++)
+		{
+			const float* delta = scratch.WindowRow(row);
+
+			ForEachRowSegment(boundsMin.y + row, boundsMin.x, boundsMin.x + size.x, [&](float* aValues, int aCol, int aCount) {
+				const float* segment = delta + (aCol - boundsMin.x);
+				if (!aValues)
+				{
+					if (std::all_of(segment, segment + aCount, [](float aValue) { return aValue == 0.0f; })) return;
+					aValues = &GetCell((boundsMin.y + row) * myGridSize.x + aCol, { aCol, boundsMin.y + row });
+				}
+				for (int col = 0; col < aCount; col++)
+				{
+					if (segment[col] != 0.0f) aValues[col] += segment[col];
+				}
+			});
+		}
+	}
+
+	template<typename Curve, typename Writer>
+	void Heatmap::TraverseInfluence(const Vector2i& aOriginCoord, const HeatTemplate& aTemplate, float aAmount, Writer&& aWrite)
+	{
+		int radius = aTemplate.dimensions / 2;
 		int maxIterations = radius + 1;
+		const int ringCount = static_cast<int>(aTemplate.ringFalloff.size());
 
-		std::set<int> visited;
-		std::queue<std::tuple<Vector2i, Vector2i, int>> bfsQueue;
+		std::shared_ptr<const ReachMask> mask = myReachMasks ? myManager->GetReachMask(aOriginCoord, radius) : nullptr;
+		if (mask)
+		{
+			// The mask already holds the step count the walk below would reach every cell with, so the fill is a plain stamp.
+			for (int row = 0; row < aTemplate.dimensions; row++)
+			{
+				const int rowEnd = mask->rowEnd[row];
+				if (mask->rowBegin[row] > rowEnd) continue;
+
+				Vector2i coord = { aOriginCoord.x - radius, aOriginCoord.y - radius + row };
+				int templateRow = row * aTemplate.dimensions;
+				int heatmapRow = coord.y * myGridSize.x + coord.x;
+
+				for (int col = mask->rowBegin[row]; col <= rowEnd; col++)
+				{
+					const int steps = mask->steps[templateRow + col];
+					if (steps == 0) continue;
+
+					const int distance = steps - 1;
+					const float falloff = distance == 0 ? 1.0f : distance < ringCount ?
+						aTemplate.ringFalloff[distance] :
+						Curve::Evaluate(static_cast<float>(distance), static_cast<float>(maxIterations));
+
+					aWrite(heatmapRow + col, Vector2i(coord.x + col, coord.y), (aTemplate.values[templateRow + col] * falloff) * aAmount);
+				}
+			}
+
+			return;
+		}
+
+		FloodFillScratch& scratch = HeatmapManager::GetFloodFillScratch();
+		scratch.Begin(aTemplate.dimensions);
 		std::array<Vector2i, 4> directions = { Vector2i(0, 1), Vector2i(-1, 0), Vector2i(0, -1), Vector2i(1, 0) };
 
 		Vector2i boundsMin = { std::max(myBoundsMin.x, aOriginCoord.x - radius), std::max(myBoundsMin.y, aOriginCoord.y - radius) };
 		Vector2i boundsMax = { std::min(myBoundsMax.x, aOriginCoord.x + radius), std::min(myBoundsMax.y, aOriginCoord.y + radius) };
 
-		bfsQueue.push({ aOriginCoord, heatTemplate.centerCell, 1 });
+		scratch.Push({ aOriginCoord, aTemplate.centerCell, 1 });
 
 		int worldStartIndex = aOriginCoord.y * myGridSize.x + aOriginCoord.x;
-		int localStartIndex = heatTemplate.centerCell.y * heatTemplate.dimensions + heatTemplate.centerCell.x;
+		int localStartIndex = aTemplate.centerCell.y * aTemplate.dimensions + aTemplate.centerCell.x;
 
-		if (worldStartIndex >= 0 && worldStartIndex < myValues.size())
+		if (worldStartIndex >= 0 && worldStartIndex < myGridSize.x * myGridSize.y)
 		{
-			myValues[worldStartIndex] += heatTemplate.values[localStartIndex] * aAmount;
-			visited.insert(worldStartIndex);
+			aWrite(worldStartIndex, aOriginCoord, aTemplate.values[localStartIndex] * aAmount);
+			scratch.Visit(localStartIndex);
 		}
 
 		float bfsFallof = 1.0f;
-		int distance = 1;
-		int iteration = 1;
-		while (!bfsQueue.empty())
+		while (!scratch.Empty())
 		{
-			Vector2i nextLocalCoord, nextTemplateCoord;
-			Vector2i localCoord, templateCoord;
-
-			std::tie(localCoord, templateCoord, distance) = bfsQueue.front();
-			bfsQueue.pop();
+			const FloodFillNode node = scratch.Pop();
 
-			bfsFallof = curveFunc(static_cast<float>(distance), static_cast<float>(maxIterations));
+			// Only paths detouring around obstacles can outrun the precomputed rings.
+			bfsFallof = node.distance < ringCount ?
+				aTemplate.ringFalloff[node.distance] :
+				Curve::Evaluate(static_cast<float>(node.distance), static_cast<float>(maxIterations));
 
 			for (const auto& direction : directions)
 			{
-				nextLocalCoord = localCoord + direction;
-				nextTemplateCoord = templateCoord + direction;
+				Vector2i nextLocalCoord = node.coord + direction;
+				Vector2i nextTemplateCoord = node.templateCoord + direction;
 
 				if (nextLocalCoord.x < boundsMin.x || nextLocalCoord.x > boundsMax.x ||
 					nextLocalCoord.y < boundsMin.y || nextLocalCoord.y > boundsMax.y) {
@@ -78,15 +947,14 @@ namespace AI
 				}
 
 				int heatmapIndex = nextLocalCoord.y * myGridSize.x + nextLocalCoord.x;
-				int templateIndex = nextTemplateCoord.y * heatTemplate.dimensions + nextTemplateCoord.x;
+				int templateIndex = nextTemplateCoord.y * aTemplate.dimensions + nextTemplateCoord.x;
 
-				if (!myValidCells->at(heatmapIndex)) continue;
+				if (!(*myValidCells)[heatmapIndex]) continue;
 
-				if (visited.find(heatmapIndex) == visited.end())
+				if (scratch.Visit(templateIndex))
 				{
-					myValues[heatmapIndex] += (heatTemplate.values[templateIndex] * bfsFallof) * aAmount;
-					bfsQueue.push({ nextLocalCoord, nextTemplateCoord, distance + 1 });
-					visited.insert(heatmapIndex);
+					aWrite(heatmapIndex, nextLocalCoord, (aTemplate.values[templateIndex] * bfsFallof) * aAmount);
+					scratch.Push({ nextLocalCoord, nextTemplateCoord, node.distance + 1 });
 				}
 			}
 		}
@@ -1,4 +1,6 @@
 #pragma once
+#include <cmath>
+#include <memory>
 #include <mutex>
 
 namespace KE
@@ -10,8 +12,41 @@ namespace AI
 {
 	struct InfluenceData;
 	struct HeatTemplate;
+	struct Footprint;
+	struct SeparableKernel;
 	class HeatmapManager;
 
+	// Published, read-only copy of a heatmap. Readers keep the snapshot alive for as long as they query it.
+	struct HeatmapSnapshot
+	{
+		static constexpr int TileSize = 32;
+
+		std::vector<float> values; // Dense layers, row-major.
+		std::vector<std::unique_ptr<float[]>> tiles; // Sparse layers, TileSize * TileSize cells each, missing tiles are zero.
+		std::vector<short> quantized; // Quantized dense layers, row-major, in steps of quantizeStep.
+		float quantizeStep = 0.0f;
+		std::vector<unsigned int> tileVersions;
+		unsigned int version = 0;
+		int width = 0;
+		int tileColumns = 0;
+
+		inline bool IsSparse() const { return !tiles.empty(); }
+		inline bool IsQuantized() const { return !quantized.empty(); }
+		inline float GetValue(const int aRow, const int aCol) const;
+		// Hands aVisit(values, stride, row, rows, col, count) the cells in [aRowBegin, aRowEnd) x [aColBegin, aColEnd),
+		// one block per tile on a sparse layer and in one block on a dense one. Rows of a block are stride floats apart,
+		// values are null for missing tiles. Not for quantized layers.
+		template<typename Visit>
+		inline void ForEachBlock(const int aRowBegin, const int aRowEnd, const int aColBegin, const int aColEnd, Visit&& aVisit) const;
+
+		// Only kept when the layer has region queries enabled. The summed-area table has a zero row and column in
+		// front, so it is (width + 1) * (height + 1). Pyramid level 0 holds one entry per tile and every level above
+		// halves it, rounding up, until a single entry covers the whole map.
+		std::vector<double> summedArea;
+		std::vector<std::vector<float>> maxPyramid;
+		std::vector<std::vector<float>> minPyramid;
+	};
+
 	class Heatmap
 	{
 		friend class HeatmapManager;
@@ -19,6 +54,10 @@ namespace AI
 		KE_EDITOR_FRIEND;
 
 	public:
+		// Cells are grouped in square tiles for locking and change tracking. Storage itself stays row-major unless
+		// the layer is sparse.
+		static constexpr int TileSize = HeatmapSnapshot::TileSize;
+
 		Heatmap(HeatmapManager* aManager);
 		Heatmap() {};
 		virtual ~Heatmap() {}
@@ -26,16 +65,140 @@ namespace AI
 		virtual void DebugRender(KE::DebugRenderer* aDbg);
 		 
 		virtual void FloodFillInfluence(const Vector2i& aOriginCoord, const InfluenceData& aData, float aAmount = 1.0f);
-		virtual void Clear() { std::fill(myValues.begin(), myValues.end(), 0.0f); }
+		// Same as FloodFillInfluence, and records what was written into aOutFootprint.
+		void PaintInfluence(const Vector2i& aOriginCoord, const InfluenceData& aData, float aAmount, Footprint& aOutFootprint);
+		// Subtracts a recorded footprint and clears it. Replays the values as they were painted, so it stays exact
+		// even if the valid cells changed since.
+		void EraseFootprint(Footprint& aFootprint);
+		// Moves an imprint by writing (new - old) in one pass over the union of both footprints. With a footprint the
+		// old imprint is erased from it when recorded, and the new one is recorded in its place.
+		void MoveInfluence(const Vector2i& aFromCoord, const Vector2i& aToCoord, const InfluenceData& aData, float aAmount = 1.0f, Footprint* aFootprint = nullptr);
+		virtual void Clear();
+
+		// Convolve painting, for layers where so many users move that flood filling each of them costs more than
+		// rebuilding the layer. Painted values are cleared, every kernel's impulse grid (one amount per cell) is
+		// convolved into them and cells off the navmesh are zeroed at the end. Obstacles only mask the result,
+		// influence is not kept from reaching around or through them like the flood fill does.
+		void ClearInfluence();
+		void ConvolveInfluence(const std::vector<float>& aImpulses, const SeparableKernel& aKernel);
+		void MaskInvalidCells();
+
+		// Static influences are baked into a separate base that repaints never touch. Publish adds it to the painted
+		// values, so snapshots and everything reading them see both.
+		void ClearStatic();
+		void BakeInfluence(const Vector2i& aOriginCoord, const InfluenceData& aData, float aAmount = 1.0f);
+		// Influence of static level features baked offline, one value per cell. Publish adds it under the static base
+		// and clearing keeps it. Read in place, it has to outlive the map or be replaced.
+		void SetLevelStatic(const float* aValues);
+
+		// Sparse layers only allocate the tiles something was painted into, and free them again on publish once every
+		// cell is back to zero. Meant for large maps where influence covers a small part. The static base, region
+		// data and the convolve scratch stay full size when used. Converts what is painted already.
+		void SetSparse(const bool aSparse);
+		inline bool IsSparse() const { return mySparse; }
+
+		// Quantized layers round every painted value to a multiple of aStep, rounded to a power of two so the sums
+		// stay exact: removing an imprint cancels painting it to the bit. Dense layers also publish int16 steps
+		// instead of floats, which halves what snapshots take and what workmaps read, values beyond 32767 steps
+		// saturate. Sparse layers publish float tiles. 0 goes back to plain floats, what is painted is kept.
+		// aFootprints are the recorded footprints painted into the layer. They are rounded to the new step with it
+		// and the cells are rebuilt from them, so erasing them later still cancels exactly.
+		void SetQuantization(const float aStep, const std::vector<Footprint*>& aFootprints = {});
+		inline float GetQuantizationStep() const { return myQuantizeStep; }
+
+		// Copies the tiles changed since the recycled snapshot was current and swaps it in for readers.
+		void Publish();
+		inline std::shared_ptr<const HeatmapSnapshot> GetSnapshot() const { return std::atomic_load(&myPublished); }
+		inline unsigned int GetVersion() const { return myVersion; }
+		// Sum of the snapshot's versions of the tiles under a cell box. Tile versions only grow, so an equal sum means nothing in the box changed.
+		unsigned long long GetWindowVersion(const HeatmapSnapshot& aSnapshot, const Vector2i& aCellMin, const Vector2i& aCellMax) const;
+
+		// Keeps a summed-area table and min/max tile pyramid on every published snapshot. Not thread-safe against Publish.
+		void SetRegionQueries(const bool aEnabled);
+		inline bool HasRegionQueries() const { return myRegionQueries; }
+		// Inclusive cell boxes, clipped to the map. Both fall back to scanning the values when region queries are off.
+		double GetRegionSum(const HeatmapSnapshot& aSnapshot, const Vector2i& aCellMin, const Vector2i& aCellMax) const;
+		float GetRegionMax(const HeatmapSnapshot& aSnapshot, const Vector2i& aCellMin, const Vector2i& aCellMax) const;
 
 		inline Vector3f GetPosByIndex(const int aIndex) const;
 		inline Vector2i GetCoordinate(const Vector3f& aPos) const;
 		inline int GetIndexByPos(const Vector3f& aPos) const;
 		
 	protected:
-		void LockMutex() { this->myMutex.lock(); }
-		void UnlockMutex() { this->myMutex.unlock(); }
-		std::mutex myMutex;
+		// Walks the reachable footprint of a template and hands every cell and its value to aWrite(index, coord, value).
+		template<typename Curve, typename Writer>
+		void TraverseInfluence(const Vector2i& aOriginCoord, const HeatTemplate& aTemplate, float aAmount, Writer&& aWrite);
+
+		// Storage access that works for dense and sparse layers, tiles are allocated on write.
+		inline float& GetCell(const int aIndex, const Vector2i& aCoord);
+		// Adding zero never allocates a tile.
+		inline void AddToCell(const int aIndex, const Vector2i& aCoord, const float aValue)
+		{
+			if (!mySparse) myValues[aIndex] += aValue;
+			else if (aValue != 0.0f) GetCell(aIndex, aCoord) += aValue;
+		}
+		inline float Quantize(const float aValue) const
+		{
+			return myQuantizeStep > 0.0f ? std::round(aValue * myInvQuantizeStep) * myQuantizeStep : aValue;
+		}
+		inline float* GetTile(const int aTile);
+		// Hands aVisit(values, col, count) the row between aColBegin and aColEnd (exclusive), one piece per tile on a
+		// sparse layer. Values are null for tiles not allocated yet: writers adding something non-zero get the tile
+		// from GetCell, erasing and clearing skip it.
+		template<typename Visit>
+		inline void ForEachRowSegment(const int aRow, const int aColBegin, const int aColEnd, Visit&& aVisit);
+		void PublishSparseTile(HeatmapSnapshot& aSnapshot, const int aTile);
+		// Adds aScale times a footprint's values back in place, tiles locked by the caller. Missing tiles are only
+		// allocated when adding.
+		void AddFootprint(const Footprint& aFootprint, const float aScale);
+		inline bool HasStaticBase() const { return myLevelValues || !myStaticValues.empty(); }
+		void AddStaticBase(float* aValues, const int aIndex, const int aCount) const;
+
+		// Tiles are always locked in ascending index order, so overlapping regions can't deadlock.
+		void LockTiles(const Vector2i& aCellMin, const Vector2i& aCellMax);
+		void UnlockTiles(const Vector2i& aCellMin, const Vector2i& aCellMax);
+		void MarkTilesDirty(const Vector2i& aCellMin, const Vector2i& aCellMax);
+		void ClearDirtyTiles() { std::fill(myDirtyTiles.begin(), myDirtyTiles.end(), 0); }
+		inline bool IsTileDirty(const int aTile) const { return myDirtyTiles[aTile] != 0; }
+		inline bool GetTileRange(const Vector2i& aCellMin, const Vector2i& aCellMax, Vector2i& aOutMin, Vector2i& aOutMax) const;
+
+		// Brings the region data of a snapshot up to date for the tiles that were just copied into it.
+		void UpdateRegionData(HeatmapSnapshot& aSnapshot, const std::vector<int>& aChangedTiles) const;
+		void VisitRegionMax(const HeatmapSnapshot& aSnapshot, const int aLevel, const Vector2i& aNode, const Vector2i& aCellMin, const Vector2i& aCellMax, float& aBest) const;
+		inline Vector2i GetPyramidSize(const int aLevel) const
+		{
+			return { (myTileCount.x + (1 << aLevel) - 1) >> aLevel, (myTileCount.y + (1 << aLevel) - 1) >> aLevel };
+		}
+
+		// Locks the tiles under a cell box for writing and flags them as changed.
+		class TileWriteScope
+		{
+		public:
+			TileWriteScope(Heatmap& aMap, const Vector2i& aCellMin, const Vector2i& aCellMax) :
+				myMap(aMap), myCellMin(aCellMin), myCellMax(aCellMax)
+			{
+				myMap.LockTiles(myCellMin, myCellMax);
+				myMap.MarkTilesDirty(myCellMin, myCellMax);
+			}
+			~TileWriteScope() { myMap.UnlockTiles(myCellMin, myCellMax); }
+
+		private:
+			Heatmap& myMap;
+			Vector2i myCellMin;
+			Vector2i myCellMax;
+		};
+
+		Vector2i myTileCount;
+		std::unique_ptr<std::mutex[]> myTileMutexes;
+		std::vector<unsigned char> myDirtyTiles;
+		std::vector<unsigned int> myTileVersions;
+		std::vector<int> myChangedTiles;
+		bool myRegionQueries = false;
+
+		// Readers only ever see myPublished, painting goes to myValues and becomes visible on Publish.
+		std::shared_ptr<const HeatmapSnapshot> myPublished;
+		std::shared_ptr<HeatmapSnapshot> myRecycled;
+		unsigned int myVersion = 0;
 
 		Vector2i myWorldOrigin;
 		Vector2i myGridSize;
@@ -43,12 +206,105 @@ namespace AI
 		Vector2i myBoundsMax;
 		Vector2f myMin;
 		Vector2f myMax;
-		std::vector<float> myValues;
+		std::vector<float> myValues; // Empty on sparse layers.
+		std::vector<std::unique_ptr<float[]>> myTiles; // Sparse layers only, null until painted into.
+		bool mySparse = false;
+		const float mySparseZero = 1e-5f; // Tiles are freed once every cell is within this of zero.
+		float myQuantizeStep = 0.0f;
+		float myInvQuantizeStep = 0.0f;
+		std::vector<float> myPublishRow; // Painted plus static values of one tile row on their way to being quantized.
+		std::vector<float> myStaticValues; // Empty until something static is baked.
+		const float* myLevelValues = nullptr; // Not owned, usually the mapped level bake.
+		std::vector<float> myConvolveRows; // Row pass of the convolution, only rows near an impulse are ever used.
+		std::vector<unsigned char> myImpulseRows;
 		float myCellSize = 1.0f;
 		const std::vector<bool>* myValidCells = nullptr;
 		HeatmapManager* myManager = nullptr;
+		bool myReachMasks = true; // Reach masks are in world cells, maps with their own grid walk instead.
 	};
 
+	inline float HeatmapSnapshot::GetValue(const int aRow, const int aCol) const
+	{
+		if (!quantized.empty()) return quantized[aRow * width + aCol] * quantizeStep;
+		if (tiles.empty()) return values[aRow * width + aCol];
+
+		const float* tile = tiles[(aRow / TileSize) * tileColumns + aCol / TileSize].get();
+		return tile ? tile[(aRow % TileSize) * TileSize + aCol % TileSize] : 0.0f;
+	}
+	template<typename Visit>
+	inline void HeatmapSnapshot::ForEachBlock(const int aRowBegin, const int aRowEnd, const int aColBegin, const int aColEnd, Visit&& aVisit) const
+	{
+		if (tiles.empty())
+		{
+			aVisit(values.data() + aRowBegin * width + aColBegin, width, aRowBegin, aRowEnd - aRowBegin, aColBegin, aColEnd - aColBegin);
+			return;
+		}
+
+		for (int row = aRowBegin; row < aRowEnd;)
+		{
+			const int tileY = row / TileSize;
+			const int rowEnd = std::min(aRowEnd, (tileY + 1) * TileSize);
+			const std::unique_ptr<float[]>* tileRow = tiles.data() + tileY * tileColumns;
+			const int rowOffset = (row - tileY * TileSize) * TileSize;
+
+			for (int col = aColBegin; col < aColEnd;)
+			{
+				const int tileX = col / TileSize;
+				const int colEnd = std::min(aColEnd, (tileX + 1) * TileSize);
+				const float* tile = tileRow[tileX].get();
+
+				aVisit(tile ? tile + rowOffset + (col - tileX * TileSize) : nullptr, TileSize, row, rowEnd - row, col, colEnd - col);
+				col = colEnd;
+			}
+			row = rowEnd;
+		}
+	}
+
+	inline float& Heatmap::GetCell(const int aIndex, const Vector2i& aCoord)
+	{
+		if (!mySparse) return myValues[aIndex];
+
+		return GetTile((aCoord.y / TileSize) * myTileCount.x + aCoord.x / TileSize)[(aCoord.y % TileSize) * TileSize + aCoord.x % TileSize];
+	}
+	inline float* Heatmap::GetTile(const int aTile)
+	{
+		// Only ever called with the tile locked, so two writers never allocate the same one.
+		if (!myTiles[aTile]) myTiles[aTile] = std::make_unique<float[]>(TileSize * TileSize);
+
+		return myTiles[aTile].get();
+	}
+	template<typename Visit>
+	inline void Heatmap::ForEachRowSegment(const int aRow, const int aColBegin, const int aColEnd, Visit&& aVisit)
+	{
+		if (!mySparse)
+		{
+			aVisit(myValues.data() + aRow * myGridSize.x + aColBegin, aColBegin, aColEnd - aColBegin);
+			return;
+		}
+
+		const int tileRow = (aRow / TileSize) * myTileCount.x;
+		const int rowOffset = (aRow % TileSize) * TileSize;
+
+		for (int col = aColBegin; col < aColEnd;)
+		{
+			int tileX = col / TileSize;
+			int end = std::min(aColEnd, (tileX + 1) * TileSize);
+
+			float* tile = myTiles[tileRow + tileX].get();
+
+			aVisit(tile ? tile + rowOffset + (col - tileX * TileSize) : nullptr, col, end - col);
+			col = end;
+		}
+	}
+	inline bool Heatmap::GetTileRange(const Vector2i& aCellMin, const Vector2i& aCellMax, Vector2i& aOutMin, Vector2i& aOutMax) const
+	{
+		if (!myTileMutexes) return false;
+
+		aOutMin = { std::max(0, aCellMin.x) / TileSize, std::max(0, aCellMin.y) / TileSize };
+		aOutMax = { std::min(myGridSize.x - 1, aCellMax.x) / TileSize, std::min(myGridSize.y - 1, aCellMax.y) / TileSize };
+
+		return aOutMin.x <= aOutMax.x && aOutMin.y <= aOutMax.y;
+	}
 	inline Vector3f Heatmap::GetPosByIndex(const int aIndex) const
 	{
 		Vector2i coord = { (aIndex % myGridSize.x), (aIndex / myGridSize.x) };
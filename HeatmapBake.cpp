@@ -0,0 +1,142 @@
+#include "stdafx.h"
+#include "HeatmapBake.h"
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace AI
+{
+	unsigned long long HeatmapBake::Checksum(const unsigned char* aData, const size_t aSize)
+	{
+		// FNV-1a over 64-bit words, the byte-wise version is too slow for layers of millions of cells.
+		unsigned long long hash = 0xCBF29CE484222325ull;
+		size_t words = aSize / sizeof(unsigned long long);
+
+		for (size_t i = 0; i < words; i++)
+		{
+			unsigned long long word;
+			memcpy(&word, aData + i * sizeof(unsigned long long), sizeof(word));
+			hash = (hash ^ word) * 0x100000001B3ull;
+		}
+
+		for (size_t i = words * sizeof(unsigned long long); i < aSize; i++)
+		{
+			hash = (hash ^ aData[i]) * 0x100000001B3ull;
+		}
+
+		return hash;
+	}
+
+	const HeatmapBakeHeader* HeatmapBake::Validate(const unsigned char* aData, const size_t aSize, const unsigned long long aNavmeshHash)
+	{
+		if (!aData || aSize < sizeof(HeatmapBakeHeader)) return nullptr;
+
+		const HeatmapBakeHeader* header = reinterpret_cast<const HeatmapBakeHeader*>(aData);
+		if (header->magic != HeatmapBakeHeader::Magic || header->version != HeatmapBakeHeader::Version) return nullptr;
+		if (header->fileSize != aSize || header->navmeshHash != aNavmeshHash) return nullptr;
+		if (header->gridSize[0] <= 0 || header->gridSize[1] <= 0) return nullptr;
+
+		// Offsets are only trusted once the checksum says the file is the one that was written.
+		if (Checksum(aData + sizeof(HeatmapBakeHeader), aSize - sizeof(HeatmapBakeHeader)) != header->checksum) return nullptr;
+
+		auto fits = [aSize](const unsigned long long aOffset, const unsigned long long aBytes)
+		{
+			return aOffset <= aSize && aBytes <= aSize - aOffset;
+		};
+
+		unsigned long long cells = static_cast<unsigned long long>(header->gridSize[0]) * header->gridSize[1];
+		int staticLayers = 0;
+		for (unsigned int mask = header->staticLayerMask; mask; mask &= mask - 1) staticLayers++;
+
+		if (!fits(header->validCellsOffset, (cells + 7) / 8) ||
+			!fits(header->templatesOffset, header->templateCount * sizeof(HeatmapBakeTemplate)) ||
+			!fits(header->staticLayersOffset, staticLayers * cells * sizeof(float))) {
+			return nullptr;
+		}
+
+		const HeatmapBakeTemplate* templates = reinterpret_cast<const HeatmapBakeTemplate*>(aData + header->templatesOffset);
+		for (unsigned int i = 0; i < header->templateCount; i++)
+		{
+			const HeatmapBakeTemplate& baked = templates[i];
+			// Kernels and the ring falloff index rings up to the template's width, SaveBake always writes one more.
+			if (baked.cellRadius < 0 || baked.dimensions != baked.cellRadius * 2 + 1 || baked.ringCount != baked.dimensions + 1 ||
+				baked.falloff < 0 || baked.falloff >= static_cast<int>(FalloffType::COUNT) ||
+				!fits(baked.valuesOffset, static_cast<unsigned long long>(baked.dimensions) * baked.dimensions * sizeof(float)) ||
+				!fits(baked.ringOffset, static_cast<unsigned long long>(baked.ringCount) * sizeof(float))) {
+				return nullptr;
+			}
+		}
+
+		return header;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(const std::string& aPath)
+	{
+		Close();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(aPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER size;
+		HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+		const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+		if (!view)
+		{
+			if (mapping) CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		myFile = file;
+		myMapping = mapping;
+		myData = static_cast<const unsigned char*>(view);
+		mySize = static_cast<size_t>(size.QuadPart);
+#else
+		int file = open(aPath.c_str(), O_RDONLY);
+		if (file < 0) return false;
+
+		struct stat info;
+		void* view = fstat(file, &info) == 0 && info.st_size > 0 ? mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+		close(file);
+
+		if (view == MAP_FAILED) return false;
+
+		myData = static_cast<const unsigned char*>(view);
+		mySize = static_cast<size_t>(info.st_size);
+#endif
+
+		return true;
+	}
+	void MappedFile::Close()
+	{
+		if (!myData) return;
+
+#ifdef _WIN32
+		UnmapViewOfFile(myData);
+		CloseHandle(myMapping);
+		CloseHandle(myFile);
+		myMapping = nullptr;
+		myFile = nullptr;
+#else
+		munmap(const_cast<unsigned char*>(myData), mySize);
+#endif
+
+		myData = nullptr;
+		mySize = 0;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <Engine/Source/AI/HeatmapSystem/HeatmapCommonData.h>
+
+namespace AI
+{
+	// Baked level data for HeatmapManager::Init, written offline by HeatmapManager::SaveBake. Every section starts on a
+	// SectionAlignment boundary and is addressed by its byte offset from the start of the file, so a mapped file is
+	// read as is. Multi-byte values are in the byte order of the machine that baked it.
+	struct HeatmapBakeHeader
+	{
+		static constexpr unsigned int Magic = 0x4B424D48; // "HMBK"
+		static constexpr unsigned int Version = 1;
+
+		unsigned int magic = Magic;
+		unsigned int version = Version;
+		unsigned long long fileSize = 0;
+		unsigned long long checksum = 0; // HeatmapBake::Checksum of everything after the header.
+		unsigned long long navmeshHash = 0;
+
+		float cellSize = 1.0f;
+		float min[2] = {};
+		float max[2] = {};
+		int gridSize[2] = {};
+
+		unsigned long long validCellsOffset = 0; // One bit per cell, row-major, lowest bit of each byte first.
+		unsigned long long templatesOffset = 0; // templateCount HeatmapBakeTemplate records.
+		unsigned int templateCount = 0;
+		unsigned int staticLayerMask = 0; // Bit per layer index that has a baked static base.
+		unsigned long long staticLayersOffset = 0; // One float grid per set bit, in layer order.
+	};
+
+	struct HeatmapBakeTemplate
+	{
+		int falloff = 0;
+		int cellRadius = 0;
+		int dimensions = 0;
+		int ringCount = 0;
+		unsigned long long valuesOffset = 0; // dimensions * dimensions floats.
+		unsigned long long ringOffset = 0; // ringCount floats.
+	};
+
+	namespace HeatmapBake
+	{
+		static constexpr size_t SectionAlignment = 64;
+
+		unsigned long long Checksum(const unsigned char* aData, const size_t aSize);
+		// Null unless the file is complete, of this version, baked for this navmesh, intact and every section is
+		// inside the file.
+		const HeatmapBakeHeader* Validate(const unsigned char* aData, const size_t aSize, const unsigned long long aNavmeshHash);
+	}
+
+	// Read-only view of a whole file, stays valid until Close or destruction.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool Open(const std::string& aPath);
+		void Close();
+
+		inline const unsigned char* GetData() const { return myData; }
+		inline size_t GetSize() const { return mySize; }
+
+	private:
+		const unsigned char* myData = nullptr;
+		size_t mySize = 0;
+#ifdef _WIN32
+		void* myFile = nullptr;
+		void* myMapping = nullptr;
+#endif
+	};
+}
\ No newline at end of file
@@ -18,11 +18,24 @@ namespace AI
 		COUNT
 	};
 
+	// Every Team/HeatType pair has its own heatmap, addressed by a flat layer index.
+	static constexpr int LayerCount = static_cast<int>(Team::COUNT) * static_cast<int>(HeatType::COUNT);
+
+	static inline int GetLayerIndex(const Team aTeam, const HeatType aType)
+	{
+		return static_cast<int>(aTeam) * static_cast<int>(HeatType::COUNT) + static_cast<int>(aType);
+	}
+	static inline Team GetLayerTeam(const int aLayer) { return static_cast<Team>(aLayer / static_cast<int>(HeatType::COUNT)); }
+	static inline HeatType GetLayerType(const int aLayer) { return static_cast<HeatType>(aLayer % static_cast<int>(HeatType::COUNT)); }
+
 	enum class FalloffType
 	{
 		Linear,
 		EaseInQuint,
 		InverseLinear,
+		EaseInCirc,
+		Read,
+		Attractor,
 		COUNT
 	};
 
@@ -31,31 +44,187 @@ namespace AI
 		int radius = 1;
 		float maxValue = 1.0f;
 		HeatType type = HeatType::COUNT;
-		FalloffType fallofType = FalloffType::Linear;
+		FalloffType fallofType = FalloffType::COUNT; // COUNT falls back to the default curve of the HeatType.
+	};
+
+	class InfluenceComponent;
+
+	// One weighted layer read in a workmap query, a negative weight subtracts the layer.
+	struct WorkmapTerm
+	{
+		Team team = Team::COUNT;
+		HeatType type = HeatType::COUNT;
+		float weight = 1.0f;
+	};
+
+	// Full description of a workmap query so many agents can be evaluated in one batch.
+	struct WorkmapQuery
+	{
+		Vector3f position;
+		int radius = 1;
+		std::vector<WorkmapTerm> terms;
+		const InfluenceComponent* excludedUser = nullptr; // Removes this user's own imprint of excludedType.
+		HeatType excludedType = HeatType::COUNT;
+		bool normalize = false;
 	};
 
 	struct HeatTemplate
 	{
 		int dimensions = NULL;
 		Vector2i centerCell;
+		FalloffType falloff = FalloffType::Linear;
 		std::vector<float> values;
+		std::vector<float> ringFalloff; // Falloff per BFS distance, covers every distance reachable without detours.
 	};
 
-	static inline FalloffFunction GetFalloffFunction(const AI::HeatType aType)
+	struct FloodFillNode
+	{
+		Vector2i coord;
+		Vector2i templateCoord;
+		int distance = 0;
+	};
+
+	// Reusable BFS state for flood fills. Cells are tracked in template space, so the buffers only
+	// need to cover one template window and are grown to the largest window seen.
+	// Visited cells are stamped with the current epoch, which avoids clearing the buffer between fills.
+	class FloodFillScratch
+	{
+	public:
+		inline void Begin(const int aDimensions)
+		{
+			size_t cellCount = static_cast<size_t>(aDimensions * aDimensions);
+			if (myVisited.size() < cellCount)
+			{
+				myVisited.resize(cellCount, 0);
+				myQueue.resize(cellCount);
+			}
+
+			// Every stamp in the buffer is stale once the epoch wraps around.
+			if (++myEpoch == 0)
+			{
+				std::fill(myVisited.begin(), myVisited.end(), 0);
+				myEpoch = 1;
+			}
+
+			myHead = 0;
+			myTail = 0;
+		}
+
+		// Returns true the first time a cell is visited during the current fill.
+		inline bool Visit(const int aTemplateIndex)
+		{
+			if (myVisited[aTemplateIndex] == myEpoch) return false;
+
+			myVisited[aTemplateIndex] = myEpoch;
+			return true;
+		}
+
+		// Every cell is queued at most once per fill, so the queue never outgrows the window.
+		inline void Push(const FloodFillNode& aNode) { myQueue[myTail++] = aNode; }
+		inline const FloodFillNode& Pop() { return myQueue[myHead++]; }
+		inline bool Empty() const { return myHead == myTail; }
+
+		// Zeroed accumulation buffer covering a rectangle of grid cells, used to merge several fills before writing them out.
+		inline void BeginWindow(const Vector2i& aMin, const Vector2i& aSize)
+		{
+			myWindowMin = aMin;
+			myWindowSize = aSize;
+			myWindow.assign(static_cast<size_t>(aSize.x * aSize.y), 0.0f);
+		}
+		inline bool InWindow(const Vector2i& aCoord) const
+		{
+			return static_cast<unsigned int>(aCoord.x - myWindowMin.x) < static_cast<unsigned int>(myWindowSize.x) &&
+				static_cast<unsigned int>(aCoord.y - myWindowMin.y) < static_cast<unsigned int>(myWindowSize.y);
+		}
+		inline float& WindowAt(const Vector2i& aCoord)
+		{
+			return myWindow[(aCoord.y - myWindowMin.y) * myWindowSize.x + (aCoord.x - myWindowMin.x)];
+		}
+		inline const float* WindowRow(const int aRow) const { return myWindow.data() + aRow * myWindowSize.x; }
+		inline const Vector2i& WindowMin() const { return myWindowMin; }
+		inline const Vector2i& WindowSize() const { return myWindowSize; }
+
+	private:
+		std::vector<unsigned int> myVisited;
+		std::vector<FloodFillNode> myQueue;
+		std::vector<float> myWindow;
+		Vector2i myWindowMin;
+		Vector2i myWindowSize;
+		unsigned int myEpoch = 0;
+		int myHead = 0;
+		int myTail = 0;
+	};
+
+	// Cells and values one imprint last painted into a layer, kept so it can be taken back out without a flood fill.
+	// Runs are horizontal spans of the layer, their values are stored back to back in run order.
+	struct Footprint
+	{
+		struct Run
+		{
+			int index = 0;
+			int length = 0;
+		};
+
+		std::vector<Run> runs;
+		std::vector<float> values;
+		Vector2i cellMin;
+		Vector2i cellMax;
+		bool recorded = false; // An empty but recorded footprint painted nothing.
+
+		inline void Clear()
+		{
+			runs.clear();
+			values.clear();
+			recorded = false;
+		}
+	};
+
+	static inline FalloffType GetDefaultFalloff(const AI::HeatType aType)
 	{
 		switch (aType)
 		{
 		case AI::HeatType::Threat:
-			return FalloffCurve::Linear;
+			return FalloffType::Linear;
 
 		case AI::HeatType::Location:
-			return FalloffCurve::Linear;
+			return FalloffType::Linear;
 
 		case AI::HeatType::Attractor:
-			return FalloffCurve::Attractor;
+			return FalloffType::Attractor;
+
+		default:
+			return FalloffType::Linear;
+		}
+	}
+
+	static inline FalloffType GetFalloffType(const InfluenceData& aData)
+	{
+		return aData.fallofType != FalloffType::COUNT ? aData.fallofType : GetDefaultFalloff(aData.type);
+	}
+
+	// Resolves the curve once and hands the kernel a FalloffPolicy instance, so the kernel is compiled per curve.
+	template<typename Kernel>
+	static inline decltype(auto) DispatchFalloff(const FalloffType aType, Kernel&& aKernel)
+	{
+		switch (aType)
+		{
+		case FalloffType::EaseInQuint:
+			return aKernel(FalloffPolicy::EaseInQuint());
+
+		case FalloffType::InverseLinear:
+			return aKernel(FalloffPolicy::InverseLinear());
+
+		case FalloffType::EaseInCirc:
+			return aKernel(FalloffPolicy::EaseInCirc());
+
+		case FalloffType::Read:
+			return aKernel(FalloffPolicy::Read());
+
+		case FalloffType::Attractor:
+			return aKernel(FalloffPolicy::Attractor());
 
 		default:
-			return FalloffCurve::Linear;
+			return aKernel(FalloffPolicy::Linear());
 		}
 	}
 }
\ No newline at end of file
@@ -1,5 +1,10 @@
 #include "stdafx.h"
 #include "HeatmapManager.h"
+#include <Engine/Source/AI/HeatmapSystem/HeatmapSimd.h>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+#include <fstream>
 
 #include <Engine/Source/Graphics/Texture/TextureLoader.h>
 
@@ -14,9 +19,12 @@
 
 namespace AI
 {
-	HeatmapManager::HeatmapManager() : myWorkMap(this) {}
+	HeatmapManager::HeatmapManager() : myWorkMap(this), myWorkmapPool(this), myUsers(1), myStaticUsers(2) {}
 	HeatmapManager::~HeatmapManager()
 	{
+		// Join the workers before the maps they paint into are deleted.
+		myWorkerPool.Stop();
+
 		for (auto& key : myInfluenceMaps)
 		{
 			for (auto& map : key.second)
@@ -27,6 +35,152 @@ namespace AI
 	}
 
 	bool HeatmapManager::Init(float aCellSize, Vector2f aMin, Vector2f aMax)
+	{
+		InitGrid(aCellSize, aMin, aMax);
+		CreateTemplates();
+		InitLayers();
+
+		return true;
+	}
+	bool HeatmapManager::Init(const std::string& aBakePath, const unsigned long long aNavmeshHash)
+	{
+		if (!myBakeFile.Open(aBakePath)) return false;
+
+		const unsigned char* data = myBakeFile.GetData();
+		const HeatmapBakeHeader* header = HeatmapBake::Validate(data, myBakeFile.GetSize(), aNavmeshHash);
+		if (!header)
+		{
+			myBakeFile.Close();
+			return false;
+		}
+
+		InitGrid(header->cellSize, { header->min[0], header->min[1] }, { header->max[0], header->max[1] });
+		if (myGridSize.x != header->gridSize[0] || myGridSize.y != header->gridSize[1])
+		{
+			myBakeFile.Close();
+			return false;
+		}
+
+		const unsigned char* validBits = data + header->validCellsOffset;
+		for (size_t index = 0; index < myValidCells.size(); index++)
+		{
+			myValidCells[index] = (validBits[index >> 3] >> (index & 7)) & 1;
+		}
+
+		std::vector<std::shared_ptr<const HeatTemplate>> templates;
+		const HeatmapBakeTemplate* bakedTemplates = reinterpret_cast<const HeatmapBakeTemplate*>(data + header->templatesOffset);
+		for (unsigned int i = 0; i < header->templateCount; i++)
+		{
+			const HeatmapBakeTemplate& baked = bakedTemplates[i];
+			const float* values = reinterpret_cast<const float*>(data + baked.valuesOffset);
+			const float* rings = reinterpret_cast<const float*>(data + baked.ringOffset);
+
+			std::shared_ptr<HeatTemplate> heatTemplate = std::make_shared<HeatTemplate>();
+			heatTemplate->falloff = static_cast<FalloffType>(baked.falloff);
+			heatTemplate->dimensions = baked.dimensions;
+			heatTemplate->centerCell = { baked.cellRadius, baked.cellRadius };
+			heatTemplate->values.assign(values, values + baked.dimensions * baked.dimensions);
+			heatTemplate->ringFalloff.assign(rings, rings + baked.ringCount);
+			templates.push_back(heatTemplate);
+		}
+		myTemplateCache.Init(myPrebuiltTemplateSize, templates);
+
+		InitLayers();
+
+		// Static bases are read straight from the mapping, the file stays open until Reset.
+		const float* staticLayer = reinterpret_cast<const float*>(data + header->staticLayersOffset);
+		for (int layer = 0; layer < LayerCount; layer++)
+		{
+			if (!(header->staticLayerMask & (1u << layer))) continue;
+
+			GetHeatmap(GetLayerTeam(layer), GetLayerType(layer))->SetLevelStatic(staticLayer);
+			staticLayer += myValidCells.size();
+		}
+		if (header->staticLayerMask) PublishLayers();
+
+		return true;
+	}
+	bool HeatmapManager::SaveBake(const std::string& aPath, const unsigned long long aNavmeshHash, const bool aStaticLayers)
+	{
+		myWorkerPool.Wait();
+
+		std::vector<unsigned char> file(sizeof(HeatmapBakeHeader));
+		auto beginSection = [&file](const size_t aSize)
+		{
+			size_t offset = (file.size() + HeatmapBake::SectionAlignment - 1) / HeatmapBake::SectionAlignment * HeatmapBake::SectionAlignment;
+			file.resize(offset + aSize, 0);
+			return offset;
+		};
+
+		HeatmapBakeHeader header;
+		header.navmeshHash = aNavmeshHash;
+		header.cellSize = myCellSize;
+		header.min[0] = myMin.x;
+		header.min[1] = myMin.y;
+		header.max[0] = myMax.x;
+		header.max[1] = myMax.y;
+		header.gridSize[0] = myGridSize.x;
+		header.gridSize[1] = myGridSize.y;
+
+		header.validCellsOffset = beginSection((myValidCells.size() + 7) / 8);
+		for (size_t index = 0; index < myValidCells.size(); index++)
+		{
+			if (myValidCells[index]) file[header.validCellsOffset + (index >> 3)] |= static_cast<unsigned char>(1 << (index & 7));
+		}
+
+		// Only the prebuilt sizes, anything larger is rare enough to build on first use.
+		std::vector<std::shared_ptr<const HeatTemplate>> templates;
+		for (int curve = 0; curve < static_cast<int>(FalloffType::COUNT); curve++)
+		{
+			for (int radius = 0; radius < myPrebuiltTemplateSize; radius++)
+			{
+				templates.push_back(myTemplateCache.Get(static_cast<FalloffType>(curve), radius));
+			}
+		}
+
+		header.templateCount = static_cast<unsigned int>(templates.size());
+		header.templatesOffset = beginSection(templates.size() * sizeof(HeatmapBakeTemplate));
+		for (size_t i = 0; i < templates.size(); i++)
+		{
+			HeatmapBakeTemplate baked;
+			baked.falloff = static_cast<int>(templates[i]->falloff);
+			baked.cellRadius = templates[i]->dimensions / 2;
+			baked.dimensions = templates[i]->dimensions;
+			baked.ringCount = static_cast<int>(templates[i]->ringFalloff.size());
+			baked.valuesOffset = beginSection(templates[i]->values.size() * sizeof(float));
+			memcpy(file.data() + baked.valuesOffset, templates[i]->values.data(), templates[i]->values.size() * sizeof(float));
+			baked.ringOffset = beginSection(templates[i]->ringFalloff.size() * sizeof(float));
+			memcpy(file.data() + baked.ringOffset, templates[i]->ringFalloff.data(), templates[i]->ringFalloff.size() * sizeof(float));
+			memcpy(file.data() + header.templatesOffset + i * sizeof(HeatmapBakeTemplate), &baked, sizeof(baked));
+		}
+
+		std::vector<const Heatmap*> staticLayers;
+		for (int layer = 0; aStaticLayers && layer < LayerCount; layer++)
+		{
+			const Heatmap* map = GetHeatmap(GetLayerTeam(layer), GetLayerType(layer));
+			if (!map || !map->HasStaticBase()) continue;
+
+			header.staticLayerMask |= 1u << layer;
+			staticLayers.push_back(map);
+		}
+
+		header.staticLayersOffset = beginSection(staticLayers.size() * myValidCells.size() * sizeof(float));
+		for (size_t i = 0; i < staticLayers.size(); i++)
+		{
+			float* target = reinterpret_cast<float*>(file.data() + header.staticLayersOffset + i * myValidCells.size() * sizeof(float));
+			staticLayers[i]->AddStaticBase(target, 0, static_cast<int>(myValidCells.size()));
+		}
+
+		header.fileSize = file.size();
+		header.checksum = HeatmapBake::Checksum(file.data() + sizeof(HeatmapBakeHeader), file.size() - sizeof(HeatmapBakeHeader));
+		memcpy(file.data(), &header, sizeof(header));
+
+		std::ofstream stream(aPath, std::ios::binary | std::ios::trunc);
+		stream.write(reinterpret_cast<const char*>(file.data()), file.size());
+
+		return stream.good();
+	}
+	void HeatmapManager::InitGrid(float aCellSize, Vector2f aMin, Vector2f aMax)
 	{
 		KE_GLOBAL::blackboard.Register<HeatmapManager>("heatmapManager", this);
 		
@@ -39,9 +193,17 @@ namespace AI
 		myGridSize.y = myGridSize.y % 2 != 0 ? myGridSize.y : myGridSize.y + 1;
 		myWorldOrigin = { myGridSize.x / 2, myGridSize.y / 2 };
 		myValidCells.resize(myGridSize.x * myGridSize.y);
+		myReachabilityCache.Init(&myValidCells, myGridSize);
 
-		CreateTemplates();
-
+		myQueryTileCount = { (myGridSize.x + Heatmap::TileSize - 1) / Heatmap::TileSize, (myGridSize.y + Heatmap::TileSize - 1) / Heatmap::TileSize };
+		myQueryTiles = std::make_unique<std::atomic<unsigned int>[]>(myQueryTileCount.x * myQueryTileCount.y);
+		for (int tile = 0; tile < myQueryTileCount.x * myQueryTileCount.y; tile++)
+		{
+			myQueryTiles[tile].store(0, std::memory_order_relaxed);
+		}
+	}
+	void HeatmapManager::InitLayers()
+	{
 		// Create a container for both teams.
 		for (int i = 0; i < static_cast<int>(Team::COUNT); i++)
 		{
@@ -57,95 +219,165 @@ namespace AI
 
 			myInfluenceMaps[Team::Player].insert({ type, new Heatmap(this) });
 			myInfluenceMaps[Team::Enemy].insert({ type, new Heatmap(this) });
+			myInfluenceMaps[Team::Player][type]->SetSparse(mySparseLayers);
+			myInfluenceMaps[Team::Enemy][type]->SetSparse(mySparseLayers);
 			myInfluenceMaps[Team::Player][type]->Init(myGridSize, myWorldOrigin, myMin, myMax, myCellSize);
 			myInfluenceMaps[Team::Enemy][type]->Init(myGridSize, myWorldOrigin, myMin, myMax, myCellSize);
+			myInfluenceMaps[Team::Player][type]->SetQuantization(myLayerQuantization[GetLayerIndex(Team::Player, type)]);
+			myInfluenceMaps[Team::Enemy][type]->SetQuantization(myLayerQuantization[GetLayerIndex(Team::Enemy, type)]);
 		}
 
 		InitDebug();
 
-		return true;
+		// Keep a core free for the game thread, it takes part in parallel work while it waits anyway.
+		myWorkerPool.Start(std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1));
 	}
 	void HeatmapManager::CreateTemplates()
 	{
-		for (int i = 0; i < static_cast<int>(HeatType::COUNT); i++)
-		{
-			HeatType type = static_cast<HeatType>(i);
-			myImprintTemplates[type].resize(myTemplateMaxSize);
-			auto& imprintTemplates = myImprintTemplates[type];
+		// Sizes most imprints and queries use are built up front, anything larger on first use.
+		myTemplateCache.Init(myPrebuiltTemplateSize);
+	}
+	int HeatmapManager::GetCellRadius(const int aRadius) const
+	{
+		if (aRadius <= 0) return 0;
 
-			for (int r = 0; r < myTemplateMaxSize; r++)
+		return std::max(1, static_cast<int>(std::round(aRadius / myCellSize)));
+	}
+	void HeatmapManager::InitValidCells(KE::Navmesh& aNavmesh)
+	{
+		myValidRows.assign(myValidCells.size(), 0);
+
+		// IsPointInside only reads the navmesh, bands of rows are tested in parallel.
+		int bandCount = (myGridSize.y + myValidBandRows - 1) / myValidBandRows;
+		myWorkerPool.ParallelFor(bandCount, [&](int aBand)
+		{
+			int end = std::min(myGridSize.y, (aBand + 1) * myValidBandRows);
+			for (int i = aBand * myValidBandRows; i < end; i++)
 			{
-				int relativeSize = r * static_cast<int>(1.0f / myCellSize);
-				FalloffFunction curve = GetFalloffFunction(type);
-				HeatTemplate& heatTemplate = imprintTemplates[r];
+				int row = i * myGridSize.x;
 
-				InitTemplate(relativeSize, curve, heatTemplate);
-			}
-		}
+				for (int j = 0; j < myGridSize.x; j++)
+				{
+					int index = row + j;
+					Vector3f position = GetPosByIndex(index);
 
-		// All interest templates use the same curve.
-		myInterestTemplates.resize(myTemplateMaxSize);
-		for (int r = 0; r < myTemplateMaxSize; r++)
-		{
-			int relativeSize = r * static_cast<int>(1.0f / myCellSize);
+					myValidRows[index] = aNavmesh.IsPointInside(position);
+				}
+			}
+		});
 
-			InitTemplate(relativeSize, FalloffCurve::Read, myInterestTemplates[r]);
-		}
+		StoreValidCells();
 	}
-	void HeatmapManager::InitTemplate(const int aSize, FalloffFunction aFallofCurve, HeatTemplate& aTemplate)
+	void HeatmapManager::InitValidCells(const std::vector<Vector3f>& aVertices, const std::vector<int>& aIndices)
 	{
-		int dimension = (aSize * 2);
-		dimension = dimension % 2 != 0 ? dimension : dimension + 1;
+		myValidRows.assign(myValidCells.size(), 0);
 
-		aTemplate.dimensions = dimension;
-		aTemplate.values.resize(dimension * dimension);
-		aTemplate.centerCell = { dimension / 2, dimension / 2 };
+		int bandCount = (myGridSize.y + myValidBandRows - 1) / myValidBandRows;
+		myBandTriangles.resize(bandCount);
+		for (auto& band : myBandTriangles) band.clear();
 
-		int index = 0;
+		// Rows whose cell centers lie between the lowest and highest corner of a triangle.
+		auto getRowRange = [this](const Vector3f& aA, const Vector3f& aB, const Vector3f& aC, int& aOutFirst, int& aOutLast)
+		{
+			float minZ = std::min({ aA.z, aB.z, aC.z });
+			float maxZ = std::max({ aA.z, aB.z, aC.z });
+
+			aOutFirst = std::max(0, static_cast<int>(std::ceil((minZ - myMin.y) / myCellSize - 0.5f)));
+			aOutLast = std::min(myGridSize.y - 1, static_cast<int>(std::floor((maxZ - myMin.y) / myCellSize - 0.5f)));
+		};
 
-		for (int row = 0; row < dimension; row++)
+		for (int triangle = 0; triangle + 2 < static_cast<int>(aIndices.size()); triangle += 3)
 		{
-			for (int col = 0; col < dimension; col++)
-			{
-				int coordDistance = (Vector2i(col, row) - aTemplate.centerCell).LengthSqr();
-				float distance = sqrt(static_cast<float>(coordDistance)) * myCellSize;
-				float interest = aFallofCurve(distance, static_cast<float>(aSize));
+			int first = 0;
+			int last = 0;
+			getRowRange(aVertices[aIndices[triangle]], aVertices[aIndices[triangle + 1]], aVertices[aIndices[triangle + 2]], first, last);
 
-				aTemplate.values[index] = interest;
-				index++;
+			for (int band = first / myValidBandRows; first <= last && band <= last / myValidBandRows; band++)
+			{
+				myBandTriangles[band].push_back(triangle);
 			}
 		}
-	}
-	void HeatmapManager::InitValidCells(KE::Navmesh& aNavmesh)
-	{
-		for (int i = 0; i < myGridSize.y; i++)
+
+		myWorkerPool.ParallelFor(bandCount, [&](int aBand)
 		{
-			int row = i * myGridSize.x;
+			int bandFirst = aBand * myValidBandRows;
+			int bandLast = std::min(myGridSize.y, bandFirst + myValidBandRows) - 1;
 
-			for (int j = 0; j < myGridSize.x; j++)
+			for (int triangle : myBandTriangles[aBand])
 			{
-				int index = row + j;
-				Vector3f position = GetPosByIndex(index);
+				std::array<Vector3f, 3> corners = { aVertices[aIndices[triangle]], aVertices[aIndices[triangle + 1]], aVertices[aIndices[triangle + 2]] };
+
+				int first = 0;
+				int last = 0;
+				getRowRange(corners[0], corners[1], corners[2], first, last);
+
+				for (int i = std::max(first, bandFirst); i <= std::min(last, bandLast); i++)
+				{
+					// Span of the triangle along the row through the cell centers.
+					float z = myMin.y + (i + 0.5f) * myCellSize;
+					float minX = FLT_MAX;
+					float maxX = -FLT_MAX;
+
+					for (int edge = 0; edge < 3; edge++)
+					{
+						// Endpoints in a fixed order, so triangles sharing the edge get the exact same crossing and leave no gap.
+						const Vector3f& a = corners[edge].z < corners[(edge + 1) % 3].z ? corners[edge] : corners[(edge + 1) % 3];
+						const Vector3f& b = corners[edge].z < corners[(edge + 1) % 3].z ? corners[(edge + 1) % 3] : corners[edge];
+						if (a.z == b.z || z < std::min(a.z, b.z) || z > std::max(a.z, b.z)) continue;
+
+						float x = a.x + (z - a.z) * (b.x - a.x) / (b.z - a.z);
+						minX = std::min(minX, x);
+						maxX = std::max(maxX, x);
+					}
+
+					if (minX > maxX) continue;
+
+					int firstCol = std::max(0, static_cast<int>(std::ceil((minX - myMin.x) / myCellSize - 0.5f)));
+					int lastCol = std::min(myGridSize.x - 1, static_cast<int>(std::floor((maxX - myMin.x) / myCellSize - 0.5f)));
+					if (firstCol > lastCol) continue;
 
-				myValidCells[index] = aNavmesh.IsPointInside(position);
+					std::fill(myValidRows.begin() + i * myGridSize.x + firstCol, myValidRows.begin() + i * myGridSize.x + lastCol + 1, 1);
+				}
 			}
+		});
+
+		StoreValidCells();
+	}
+	void HeatmapManager::StoreValidCells()
+	{
+		// Bits of neighbouring rows share words, so packing stays on one thread.
+		for (size_t index = 0; index < myValidRows.size(); index++)
+		{
+			myValidCells[index] = myValidRows[index] != 0;
 		}
+
+		// Reachability changed under every cached result.
+		myQueryCache.Clear();
+		myReachabilityCache.Clear();
 	}
 
-	HeatTemplate& HeatmapManager::GetImprintTemplate(const InfluenceData& aImprintData)
+	std::shared_ptr<const HeatTemplate> HeatmapManager::GetImprintTemplate(const InfluenceData& aImprintData)
+	{
+		return myTemplateCache.Get(GetFalloffType(aImprintData), GetCellRadius(aImprintData.radius));
+	}
+	FloodFillScratch& HeatmapManager::GetFloodFillScratch()
 	{
-		// if the radius is bigger than what we have, return the largest template.
-		int typeMaxSize = static_cast<int>(myImprintTemplates[aImprintData.type].size() - 1);
-		int maxSize = std::min(typeMaxSize, aImprintData.radius);
+		// One scratch per thread so the repaint thread and workmap queries never share BFS state.
+		thread_local FloodFillScratch scratch;
 
-		return myImprintTemplates[aImprintData.type][maxSize];
+		return scratch;
 	}
-	HeatTemplate& HeatmapManager::GetInterestTemplate(const int aRadius)
+	std::shared_ptr<const ReachMask> HeatmapManager::GetReachMask(const Vector2i& aOrigin, const int aCellRadius)
 	{
-		// if the radius is bigger than what we have, return the largest template.
-		int maxSize = std::min(static_cast<int>(myInterestTemplates.size() - 1), aRadius);
+		if (aCellRadius > ReachabilityCache::MaxRadius) return nullptr;
+		if (aOrigin.x < 0 || aOrigin.x >= myGridSize.x || aOrigin.y < 0 || aOrigin.y >= myGridSize.y) return nullptr;
 
-		return myInterestTemplates[maxSize];
+		return myReachabilityCache.Get(aOrigin, aCellRadius);
+	}
+	std::shared_ptr<const HeatTemplate> HeatmapManager::GetInterestTemplate(const int aRadius)
+	{
+		// Workmap radii are already in cells, the template has to line up with the window cell for cell.
+		return myTemplateCache.Get(FalloffType::Read, aRadius);
 	}
 	Heatmap* HeatmapManager::GetHeatmap(Team aTeam, HeatType aType)
 	{
@@ -162,94 +394,438 @@ namespace AI
 		return nullptr;
 	}
 	Workmap* HeatmapManager::GetWorkmap(const Vector3f& aPosition, const int aRadius)
+	{
+		InitWorkmap(myWorkMap, aPosition, aRadius);
+
+		return &myWorkMap;
+	}
+	WorkmapHandle HeatmapManager::AcquireWorkmap(const Vector3f& aPosition, const int aRadius)
+	{
+		WorkmapHandle handle(&myWorkmapPool, myWorkmapPool.Acquire());
+		InitWorkmap(*handle, aPosition, aRadius);
+
+		return handle;
+	}
+	void HeatmapManager::EvaluateQueries(const std::vector<WorkmapQuery>& aQueries, std::vector<Vector3f>& aOutPositions)
+	{
+		int queryCount = static_cast<int>(aQueries.size());
+		aOutPositions.resize(queryCount);
+
+		// Sort by tile, then by cell, so queries evaluated back to back read overlapping, cache-warm windows.
+		const int tileSize = Heatmap::TileSize;
+		const int tilesPerRow = (myGridSize.x + tileSize - 1) / tileSize;
+
+		myQueryOrder.resize(queryCount);
+		for (int i = 0; i < queryCount; i++)
+		{
+			Vector2i cell = GetCoordinate(aQueries[i].position);
+			cell.x = std::clamp(cell.x, 0, myGridSize.x - 1);
+			cell.y = std::clamp(cell.y, 0, myGridSize.y - 1);
+
+			int tile = (cell.y / tileSize) * tilesPerRow + (cell.x / tileSize);
+			int cellInTile = (cell.y % tileSize) * tileSize + (cell.x % tileSize);
+
+			myQueryOrder[i] = { tile * tileSize * tileSize + cellInTile, i };
+		}
+		std::sort(myQueryOrder.begin(), myQueryOrder.end());
+
+		// Every chunk checks out one workmap and reuses its buffers for all of its queries.
+		int chunkCount = (queryCount + myQueryChunkSize - 1) / myQueryChunkSize;
+		myWorkerPool.ParallelFor(chunkCount, [&](int aChunk)
+		{
+			WorkmapHandle workmap(&myWorkmapPool, myWorkmapPool.Acquire());
+
+			int end = std::min(queryCount, (aChunk + 1) * myQueryChunkSize);
+			for (int i = aChunk * myQueryChunkSize; i < end; i++)
+			{
+				int queryIndex = myQueryOrder[i].second;
+				aOutPositions[queryIndex] = EvaluateQuery(*workmap, aQueries[queryIndex]);
+			}
+		});
+	}
+	Vector3f HeatmapManager::EvaluateQuery(Workmap& aWorkmap, const WorkmapQuery& aQuery)
+	{
+		// Versions are read before the workmap takes its snapshots, a result is never stored under newer versions than it saw.
+		thread_local std::vector<unsigned long long> versions;
+		thread_local std::vector<QueryOperation> recipe;
+		Vector2i origin = GetCoordinate(aQuery.position);
+		QueryKey key = { origin.y * myGridSize.x + origin.x, aQuery.radius, BuildQueryRecipe(aQuery, recipe) };
+
+		if (myQueryCaching)
+		{
+			GetQueryVersions(aQuery, origin, versions);
+
+			int cachedCell = -1;
+			if (myQueryCache.Find(key, recipe, versions, cachedCell))
+			{
+				MarkQueryRegion(origin, aQuery.radius);
+				return cachedCell < 0 ? aQuery.position : GetPosByIndex(cachedCell);
+			}
+		}
+
+		InitWorkmap(aWorkmap, aQuery.position, aQuery.radius);
+
+		for (const WorkmapTerm& term : aQuery.terms)
+		{
+			aWorkmap.Add(term.team, term.type, term.weight);
+		}
+
+		if (aQuery.excludedUser && aQuery.excludedUser->GetTemplate(aQuery.excludedType))
+		{
+			aWorkmap.ExcludeUserInfluence(*aQuery.excludedUser, aQuery.excludedType);
+		}
+
+		if (aQuery.normalize)
+		{
+			aWorkmap.Normalize();
+		}
+
+		int localCell = aWorkmap.FindHighestCell();
+		int worldCell = localCell < 0 ? -1 : aWorkmap.GetWorldIndex(localCell);
+
+		if (myQueryCaching)
+		{
+			myQueryCache.Store(key, recipe, versions, worldCell);
+		}
+
+		return worldCell < 0 ? aQuery.position : GetPosByIndex(worldCell);
+	}
+	size_t HeatmapManager::BuildQueryRecipe(const WorkmapQuery& aQuery, std::vector<QueryOperation>& aOutRecipe) const
+	{
+		aOutRecipe.clear();
+		for (const WorkmapTerm& term : aQuery.terms)
+		{
+			QueryOperation& operation = aOutRecipe.emplace_back();
+			operation.kind = QueryOperation::Kind::Add;
+			operation.layer = GetLayerIndex(term.team, term.type);
+			operation.scalar = term.weight;
+		}
+
+		// The exclusion is taken out where the user is painted, so its shape and cells matter, not whose it is.
+		const InfluenceData* excluded = aQuery.excludedUser ? aQuery.excludedUser->GetTemplate(aQuery.excludedType) : nullptr;
+		if (excluded)
+		{
+			Vector2i location, futureLocation;
+			GetUserCells(*aQuery.excludedUser, location, futureLocation);
+
+			QueryOperation& operation = aOutRecipe.emplace_back();
+			operation.kind = QueryOperation::Kind::Exclude;
+			operation.layer = static_cast<int>(excluded->type);
+			operation.scalar = excluded->maxValue;
+			operation.falloff = static_cast<int>(GetFalloffType(*excluded));
+			operation.radius = excluded->radius;
+			operation.cell = location.y * myGridSize.x + location.x;
+			operation.futureCell = futureLocation.y * myGridSize.x + futureLocation.x;
+		}
+
+		if (aQuery.normalize)
+		{
+			aOutRecipe.emplace_back().kind = QueryOperation::Kind::Normalize;
+		}
+
+		size_t hash = 0;
+		auto combine = [&hash](size_t aValue) { hash ^= aValue + 0x9E3779B9 + (hash << 6) + (hash >> 2); };
+		for (const QueryOperation& operation : aOutRecipe)
+		{
+			combine(static_cast<size_t>(operation.kind));
+			combine(static_cast<size_t>(operation.layer));
+			combine(std::hash<float>()(operation.scalar));
+			combine(static_cast<size_t>(operation.falloff));
+			combine(static_cast<size_t>(operation.radius));
+			combine(static_cast<size_t>(operation.cell));
+			combine(static_cast<size_t>(operation.futureCell));
+		}
+
+		return hash;
+	}
+	void HeatmapManager::GetQueryVersions(const WorkmapQuery& aQuery, const Vector2i& aOrigin, std::vector<unsigned long long>& aOutVersions)
+	{
+		Vector2i cellMin = { aOrigin.x - aQuery.radius, aOrigin.y - aQuery.radius };
+		Vector2i cellMax = { aOrigin.x + aQuery.radius, aOrigin.y + aQuery.radius };
+
+		aOutVersions.clear();
+		for (const WorkmapTerm& term : aQuery.terms)
+		{
+			Heatmap* map = GetHeatmap(term.team, term.type);
+			aOutVersions.push_back(map ? map->GetWindowVersion(*map->GetSnapshot(), cellMin, cellMax) : 0);
+		}
+	}
+	void HeatmapManager::InitWorkmap(Workmap& aWorkmap, const Vector3f& aPosition, const int aRadius)
 	{
 		int size = aRadius * 2;
 		size += ((size + 1) % 2);
 
 		Vector2i worldCoordOrigin = GetCoordinate(aPosition);
+		MarkQueryRegion(worldCoordOrigin, aRadius);
 		Vector2f coordPos = { (worldCoordOrigin.x + 1) * myCellSize, (worldCoordOrigin.y + 1) * myCellSize };
 		float halfSize = ((size / 2.0f) * myCellSize) + myCellSize * 0.5f;
 
 		Vector2f min = myMin + coordPos - Vector2f(halfSize, halfSize);
 		Vector2f max = myMin + coordPos + Vector2f(halfSize - 1, halfSize - 1);
-		myWorkMap.Init({ size, size }, worldCoordOrigin, min, max, myCellSize);
-		myWorkMap.myWorldGridSize = myGridSize;
-		myWorkMap.myScanRadius = aRadius;
-		myWorkMap.myUserPos = aPosition;
-
-		return &myWorkMap;
+		aWorkmap.Init({ size, size }, worldCoordOrigin, min, max, myCellSize);
+		aWorkmap.myWorldGridSize = myGridSize;
+		aWorkmap.myScanRadius = aRadius;
+		aWorkmap.myUserPos = aPosition;
 	}
 	float HeatmapManager::GetValueAtLocation(const Vector3f aPos, Team aTeam, HeatType aType)
 	{
 		Heatmap* map = GetHeatmap(aTeam, aType);
 		int index = map->GetIndexByPos(aPos);
+		std::shared_ptr<const HeatmapSnapshot> snapshot = map->GetSnapshot();
 
-		if (index < 0 || index >= map->myValues.size())
+		if (index < 0 || index >= myGridSize.x * myGridSize.y)
 			return 0.0f;
 
-		return map->myValues[index];
+		return snapshot->GetValue(index / myGridSize.x, index % myGridSize.x);
 	}
 
-	void HeatmapManager::Register(InfluenceComponent& aUser)
+	float HeatmapManager::GetRegionSum(const Vector3f& aMin, const Vector3f& aMax, Team aTeam, HeatType aType)
 	{
-		myUsersToAdd.push_back(&aUser);
+		Heatmap* map = GetHeatmap(aTeam, aType);
+		if (!map) return 0.0f;
+
+		return static_cast<float>(map->GetRegionSum(*map->GetSnapshot(), GetCoordinate(aMin), GetCoordinate(aMax)));
 	}
-	void HeatmapManager::DeRegister(InfluenceComponent& aUser)
+	float HeatmapManager::GetRegionMax(const Vector3f& aMin, const Vector3f& aMax, Team aTeam, HeatType aType)
 	{
-		myUsersToRemove.push_back(&aUser);
+		Heatmap* map = GetHeatmap(aTeam, aType);
+		if (!map) return 0.0f;
+
+		return map->GetRegionMax(*map->GetSnapshot(), GetCoordinate(aMin), GetCoordinate(aMax));
 	}
-	void HeatmapManager::RemoveUser(InfluenceComponent* aUser)
+	void HeatmapManager::SetRegionQueries(const bool aEnabled)
 	{
-		// Locate the user to remove //
-		InfluenceComponent* userToRemove = nullptr;
-		int index = 0;
-		for (int i = 0; i < myUsers.size(); ++i)
+		// Publish runs on the workers, never flip the flag under it.
+		myWorkerPool.Wait();
+
+		for (int layer = 0; layer < LayerCount; layer++)
 		{
-			if (myUsers[i]->GetID() == aUser->GetID())
+			if (Heatmap* map = GetHeatmap(GetLayerTeam(layer), GetLayerType(layer)))
 			{
-				userToRemove = myUsers[i];
-				index = i;
-				break;
+				map->SetRegionQueries(aEnabled);
 			}
 		}
 
-		if (!userToRemove) return;
+		PublishLayers();
+	}
+	void HeatmapManager::SetSparseLayers(const bool aSparse)
+	{
+		myWorkerPool.Wait();
+		mySparseLayers = aSparse;
 
-		// Remove user influence //
-		auto& container = myInfluenceMaps[userToRemove->myTeam];
-		for (auto& imprint : userToRemove->myImprints)
+		for (int layer = 0; layer < LayerCount; layer++)
 		{
-			HeatTemplate& heatTemplate = GetImprintTemplate(imprint);
-			Heatmap& map = *container[imprint.type];
+			if (Heatmap* map = GetHeatmap(GetLayerTeam(layer), GetLayerType(layer)))
+			{
+				map->SetSparse(aSparse);
+			}
+		}
 
-			if (imprint.type == HeatType::Location)
+		if (!myInfluenceMaps.empty()) PublishLayers();
+	}
+
+	void HeatmapManager::SetLayerQuantization(Team aTeam, HeatType aType, const float aStep)
+	{
+		myWorkerPool.Wait();
+		myLayerQuantization[GetLayerIndex(aTeam, aType)] = aStep;
+
+		if (Heatmap* map = GetHeatmap(aTeam, aType))
+		{
+			// The recorded footprints are rounded with the layer, or erasing them would leave the rounding behind.
+			std::vector<Footprint*> footprints;
+			for (int user = 0; user < myUsers.GetCount(); user++)
 			{
-				map.FloodFillInfluence(userToRemove->location, imprint, -0.5f);
-				map.FloodFillInfluence(userToRemove->location, imprint, -0.5f);
+				if (myUsers.myTeams[user] != aTeam) continue;
+
+				for (bool future : { false, true })
+				{
+					Footprint& footprint = myUsers.GetFootprint(user, aType, future);
+					if (footprint.runs.empty()) continue;
+
+					footprints.push_back(&footprint);
+					myUsers.myFootprintsChanged[user] = 1;
+				}
 			}
-			else
+
+			map->SetQuantization(aStep, footprints);
+			PublishLayers();
+		}
+	}
+
+	void HeatmapManager::Register(InfluenceComponent& aUser)
+	{
+		myRegistrations.Push({ &aUser, true });
+	}
+	void HeatmapManager::DeRegister(InfluenceComponent& aUser)
+	{
+		myRegistrations.Push({ &aUser, false });
+	}
+	void HeatmapManager::RemoveUser(const UserHandle& aHandle)
+	{
+		bool isStatic = myStaticUsers.Find(aHandle) >= 0;
+		UserRegistry& registry = isStatic ? myStaticUsers : myUsers;
+		int user = registry.Find(aHandle);
+		if (user < 0) return;
+
+		Team team = registry.myTeams[user];
+
+		// Static users are never painted into the live values, their layers are rebaked without them.
+		if (isStatic)
+		{
+			for (int type = 0; type < UserRegistry::ImprintStride; type++)
+			{
+				if (registry.GetImprint(user, static_cast<HeatType>(type)).type == HeatType::COUNT) continue;
+
+				myStaticLayersDirty[GetLayerIndex(team, static_cast<HeatType>(type))] = true;
+			}
+		}
+		else
+		{
+			// Remove user influence, replayed from the footprints where they were kept //
+			Vector2i location = registry.myLocations[user];
+			Vector2i futureLocation = registry.myFutureLocations[user];
+			auto& container = myInfluenceMaps[team];
+
+			auto erase = [&](Heatmap& aMap, const InfluenceData& aImprint, const Vector2i& aCell, float aAmount, Footprint& aFootprint)
 			{
-				map.FloodFillInfluence(userToRemove->location, imprint, -imprint.maxValue);
+				if (aFootprint.recorded) aMap.EraseFootprint(aFootprint);
+				else aMap.FloodFillInfluence(aCell, aImprint, -aAmount);
+			};
+
+			for (int type = 0; type < UserRegistry::ImprintStride; type++)
+			{
+				const InfluenceData& imprint = registry.GetImprint(user, static_cast<HeatType>(type));
+				if (imprint.type == HeatType::COUNT) continue;
+
+				int layer = GetLayerIndex(team, imprint.type);
+				if (myConvolving[layer])
+				{
+					myLayerRebuilds[layer] = LayerRebuild::Convolve;
+					continue;
+				}
+
+				Heatmap& map = *container[imprint.type];
+
+				if (imprint.type == HeatType::Location)
+				{
+					erase(map, imprint, location, 0.5f, registry.GetFootprint(user, imprint.type));
+					erase(map, imprint, futureLocation, 0.5f, registry.GetFootprint(user, imprint.type, true));
+				}
+				else
+				{
+					erase(map, imprint, location, imprint.maxValue, registry.GetFootprint(user, imprint.type));
+				}
 			}
 		}
 
 		// Remove user //
-		std::swap(myUsers[index], myUsers.back());
-		myUsers.pop_back();
+		const InfluenceComponent* component = registry.myComponents[user];
+		registry.Remove(aHandle);
+		myUserHandles.erase(component);
 	}
 	void HeatmapManager::AddUser(InfluenceComponent* aUser)
 	{
-		myUsers.push_back(aUser);
-		aUser->location = GetCoordinate(aUser->myPosition);
-		aUser->futureLocation = aUser->location;
+		// Registering twice would paint the user twice.
+		if (myUserHandles.count(aUser)) return;
+
+		Vector2i location = GetCoordinate(aUser->myPosition);
+
+		if (aUser->isStatic)
+		{
+			aUser->myHandle = myStaticUsers.Add(aUser, location);
+			myUserHandles[aUser] = aUser->myHandle;
+			int user = myStaticUsers.Find(aUser->myHandle);
+			for (int type = 0; type < UserRegistry::ImprintStride; type++)
+			{
+				if (myStaticUsers.GetImprint(user, static_cast<HeatType>(type)).type == HeatType::COUNT) continue;
+
+				myStaticLayersDirty[GetLayerIndex(aUser->myTeam, static_cast<HeatType>(type))] = true;
+			}
+			return;
+		}
+
+		aUser->myHandle = myUsers.Add(aUser, location);
+		myUserHandles[aUser] = aUser->myHandle;
 
 		// [Paint Influence upon registration] //
 		auto& container = myInfluenceMaps[aUser->myTeam];
-		for (auto& imprint : aUser->myImprints)
+		int user = myUsers.Find(aUser->myHandle);
+		for (int type = 0; type < UserRegistry::ImprintStride; type++)
 		{
-			container[imprint.type]->FloodFillInfluence(aUser->location, imprint, imprint.maxValue);
+			const InfluenceData& imprint = myUsers.GetImprint(user, static_cast<HeatType>(type));
+			if (imprint.type == HeatType::COUNT) continue;
+
+			// Convolved layers are rebuilt with the user in them once registration is done.
+			int layer = GetLayerIndex(aUser->myTeam, imprint.type);
+			if (myConvolving[layer])
+			{
+				myLayerRebuilds[layer] = LayerRebuild::Convolve;
+				continue;
+			}
+
+			PaintImprint(*container[imprint.type], user, imprint);
 		}
 	}
+	void HeatmapManager::PaintImprint(Heatmap& aMap, const int aUser, const InfluenceData& aImprint)
+	{
+		bool keepFootprint = KeepsFootprint(aImprint);
+
+		auto paint = [&](const Vector2i& aCell, float aAmount, Footprint& aFootprint)
+		{
+			if (keepFootprint) aMap.PaintInfluence(aCell, aImprint, aAmount, aFootprint);
+			else aMap.FloodFillInfluence(aCell, aImprint, aAmount);
+		};
+
+		// Location is painted as two halves from the start, the same way it is moved and removed.
+		if (aImprint.type == HeatType::Location)
+		{
+			paint(myUsers.myLocations[aUser], 0.5f, myUsers.GetFootprint(aUser, aImprint.type));
+			paint(myUsers.myFutureLocations[aUser], 0.5f, myUsers.GetFootprint(aUser, aImprint.type, true));
+		}
+		else
+		{
+			paint(myUsers.myLocations[aUser], aImprint.maxValue, myUsers.GetFootprint(aUser, aImprint.type));
+		}
+	}
+	bool HeatmapManager::GetUserCells(const InfluenceComponent& aUser, Vector2i& aOutLocation, Vector2i& aOutFutureLocation) const
+	{
+		std::shared_ptr<const UserSnapshot> snapshot = GetUserSnapshot();
+		const UserSnapshot::User* user = snapshot ? snapshot->Find(&aUser) : nullptr;
+		if (!user) return false;
+
+		aOutLocation = user->location;
+		aOutFutureLocation = user->futureLocation;
+		return true;
+	}
+	std::shared_ptr<const Footprint> HeatmapManager::GetUserFootprint(const InfluenceComponent& aUser, HeatType aType, const bool aFuture) const
+	{
+		std::shared_ptr<const UserSnapshot> snapshot = GetUserSnapshot();
+		const UserSnapshot::User* user = snapshot ? snapshot->Find(&aUser) : nullptr;
+		if (!user || aType == HeatType::COUNT) return nullptr;
+
+		return user->footprints[(aFuture ? UserRegistry::ImprintStride : 0) + static_cast<int>(aType)];
+	}
+	void HeatmapManager::SetFootprintRadius(const int aCellRadius)
+	{
+		myWorkerPool.Wait();
+		myFootprintRadius = aCellRadius;
+
+		// Dropped footprints fall back to a flood fill the next time their imprint moves or is removed.
+		for (int user = 0; user < myUsers.GetCount(); user++)
+		{
+			for (int type = 0; type < UserRegistry::ImprintStride; type++)
+			{
+				const InfluenceData& imprint = myUsers.GetImprint(user, static_cast<HeatType>(type));
+				if (imprint.type == HeatType::COUNT || KeepsFootprint(imprint)) continue;
+
+				myUsers.GetFootprint(user, imprint.type).Clear();
+				myUsers.GetFootprint(user, imprint.type, true).Clear();
+				myUsers.myFootprintsChanged[user] = 1;
+			}
+		}
+
+		PublishUsers();
+	}
 
 	void HeatmapManager::Update()
 	{
@@ -265,12 +841,32 @@ namespace AI
 		RegistrationUpdate();
 
 		myTimer += KE_GLOBAL::deltaTime;
-		if (myTimer > myUpdateFrequency && !myThreadWorking)
+		myTime += KE_GLOBAL::deltaTime;
+
+		// Moves are still picked up on the tick, painting them is spread over the frames in between.
+		if (myRepaintBudget > 0.0f)
+		{
+			if (myThreadWorking.load(std::memory_order_acquire)) return;
+
+			if (myTimer > myUpdateFrequency)
+			{
+				myTimer = 0.0f;
+				SyncPositions();
+				ScheduleRepaints();
+			}
+
+			RunScheduledRepaints();
+			return;
+		}
+
+		if (myTimer > myUpdateFrequency && !myThreadWorking.load(std::memory_order_acquire))
 		{
+			myTimer = 0.0f;
+			SyncPositions();
+
 			ON_THREAD(
-				myThreadWorking = true;
-				myRepaintThread = std::thread(&AI::HeatmapManager::RepaintInfluence, this);
-				myRepaintThread.detach();
+				myThreadWorking.store(true, std::memory_order_release);
+				myWorkerPool.Submit([this]() { RepaintInfluence(); });
 			);
 
 			NO_THREAD(RepaintInfluence())
@@ -278,93 +874,633 @@ namespace AI
 	}
 	void HeatmapManager::RegistrationUpdate()
 	{
-		if (myThreadWorking) return;
+		// Registration paints into the same maps, so it waits for the next tick while a repaint is in flight.
+		if (myThreadWorking.load(std::memory_order_acquire)) return;
+
+		myRegistrations.Drain(myPendingRegistrations);
+		if (myPendingRegistrations.empty()) return;
+
+		// Group the calls per user, keeping each user's calls in the order they were made.
+		myRegistrationOrder.resize(myPendingRegistrations.size());
+		for (size_t i = 0; i < myRegistrationOrder.size(); i++) myRegistrationOrder[i] = i;
+
+		std::stable_sort(myRegistrationOrder.begin(), myRegistrationOrder.end(), [this](size_t aLeft, size_t aRight)
+		{
+			return myPendingRegistrations[aLeft].user < myPendingRegistrations[aRight].user;
+		});
+
+		// Only the net effect per user is applied. A user added and removed in the same batch is never painted,
+		// a registered user removed and added again is repainted with its current data.
+		bool changed = false;
+		myAddOrder.clear();
 
-		for (auto userToRemove : myUsersToRemove)
+		for (size_t begin = 0, end = 0; begin < myRegistrationOrder.size(); begin = end)
 		{
-			RemoveUser(userToRemove);
+			InfluenceComponent* user = myPendingRegistrations[myRegistrationOrder[begin]].user;
+			bool removed = false;
+
+			for (end = begin; end < myRegistrationOrder.size() && myPendingRegistrations[myRegistrationOrder[end]].user == user; end++)
+			{
+				removed |= !myPendingRegistrations[myRegistrationOrder[end]].add;
+			}
+
+			// Resolved through the manager's own table, a user whose last call is a removal may be gone already.
+			size_t last = myRegistrationOrder[end - 1];
+			auto handle = myUserHandles.find(user);
+			bool registered = handle != myUserHandles.end();
+
+			if (registered && removed)
+			{
+				RemoveUser(handle->second);
+				registered = false;
+				changed = true;
+			}
+
+			if (!registered && myPendingRegistrations[last].add)
+			{
+				myAddOrder.push_back(last);
+			}
 		}
 
-		for (auto& user : myUsersToAdd)
+		// Adds go in the order they were made, so the registry and the summed layers don't depend on pointer values.
+		std::sort(myAddOrder.begin(), myAddOrder.end());
+		for (size_t index : myAddOrder)
 		{
-			AddUser(user);
+			AddUser(myPendingRegistrations[index].user);
+			changed = true;
 		}
 
-		myUsersToAdd.clear();
-		myUsersToRemove.clear();
+		if (changed)
+		{
+			RebuildLayers();
+			BakeStaticLayers();
+			PublishLayers();
+		}
+
+		myPendingRegistrations.clear();
 	}
-	void HeatmapManager::RepaintInfluence()
+	void HeatmapManager::BakeStaticLayers()
 	{
-		myThreadWorking = true;
+		// Baked from scratch every time, so registering and removing static users never accumulates float drift.
+		myWorkerPool.ParallelFor(LayerCount, [this](int aLayer)
+		{
+			if (!myStaticLayersDirty[aLayer]) return;
+
+			Heatmap* map = GetHeatmap(GetLayerTeam(aLayer), GetLayerType(aLayer));
+			if (!map) return;
+
+			map->ClearStatic();
+			for (int user = 0; user < myStaticUsers.GetCount(); user++)
+			{
+				if (myStaticUsers.myTeams[user] != GetLayerTeam(aLayer)) continue;
 
-		for (auto& user : myUsers)
+				const InfluenceData& imprint = myStaticUsers.GetImprint(user, GetLayerType(aLayer));
+				if (imprint.type == HeatType::COUNT) continue;
+
+				map->BakeInfluence(myStaticUsers.myLocations[user], imprint, imprint.maxValue);
+			}
+		});
+
+		myStaticLayersDirty.fill(false);
+	}
+	void HeatmapManager::PublishLayers()
+	{
+		myWorkerPool.ParallelFor(LayerCount, [this](int aLayer)
 		{
-			Vector2i currentLocation = GetCoordinate(user->myPosition);
+			if (Heatmap* map = GetHeatmap(GetLayerTeam(aLayer), GetLayerType(aLayer)))
+			{
+				map->Publish();
+			}
+		});
 
-			// We only update if the user has moved.
-			if (user->location == currentLocation) continue;
+		PublishUsers();
+	}
+	void HeatmapManager::PublishUsers()
+	{
+		std::shared_ptr<const UserSnapshot> previous = GetUserSnapshot();
 
-			auto& container = myInfluenceMaps[user->myTeam];
+		std::shared_ptr<UserSnapshot> snapshot = std::move(myRecycledUsers);
+		if (!snapshot || snapshot.use_count() > 1) snapshot = std::make_shared<UserSnapshot>();
+		snapshot->users.clear();
 
-			// Dynamic users can apply influence on their future location as well.
-			if (user->isDynamic)
+		auto publish = [&](UserRegistry& aRegistry, const bool aStatic)
+		{
+			for (int user = 0; user < aRegistry.GetCount(); user++)
 			{
-				// Limit future location within the grid bounds.
-				Vector2i futureLocation = GetCoordinate(user->myPosition + *user->myVelocity);
-				futureLocation.x = std::clamp(futureLocation.x, 0, myGridSize.x - 1);
-				futureLocation.y = std::clamp(futureLocation.y, 0, myGridSize.y - 1);
+				snapshot->users.emplace_back();
+				UserSnapshot::User& entry = snapshot->users.back();
+				entry.component = aRegistry.myComponents[user];
+				entry.location = aRegistry.myLocations[user];
+				entry.futureLocation = aRegistry.myFutureLocations[user];
+				entry.isStatic = aStatic;
+
+				// Static users live in the baked base and record nothing.
+				if (aStatic) continue;
+
+				// Users that didn't move or repaint since share the copies already published.
+				const UserSnapshot::User* published = previous && !aRegistry.myFootprintsChanged[user] ? previous->Find(entry.component) : nullptr;
+				if (published)
+				{
+					entry.footprints = published->footprints;
+					continue;
+				}
 
-				for (auto& imprint : user->myImprints)
+				for (int type = 0; type < UserRegistry::ImprintStride; type++)
 				{
-					// [TODO] -> Imprints should tell if the influence should be applied to future location or not.
-					HeatTemplate& heatTemplate = GetImprintTemplate(imprint);
-					Heatmap& map = *container[imprint.type];
+					const Footprint& footprint = aRegistry.GetFootprint(user, static_cast<HeatType>(type));
+					const Footprint& futureFootprint = aRegistry.GetFootprint(user, static_cast<HeatType>(type), true);
+					entry.footprints[type] = footprint.recorded ? std::make_shared<const Footprint>(footprint) : nullptr;
+					entry.footprints[UserRegistry::ImprintStride + type] = futureFootprint.recorded ? std::make_shared<const Footprint>(futureFootprint) : nullptr;
+				}
+				aRegistry.myFootprintsChanged[user] = 0;
+			}
+		};
+		publish(myUsers, false);
+		publish(myStaticUsers, true);
 
-					ON_THREAD(map.LockMutex());
+		std::sort(snapshot->users.begin(), snapshot->users.end(), [](const UserSnapshot::User& aLeft, const UserSnapshot::User& aRight)
+		{
+			return std::less<const InfluenceComponent*>()(aLeft.component, aRight.component);
+		});
 
-					if (imprint.type == HeatType::Location)
-					{
-						map.FloodFillInfluence(user->location, imprint, -0.5f);
-						map.FloodFillInfluence(user->futureLocation, imprint, -0.5f);
-						map.FloodFillInfluence(currentLocation, imprint, 0.5f);
-						map.FloodFillInfluence(futureLocation, imprint, 0.5f);
-					}
-					else
-					{
-						map.FloodFillInfluence(user->location, imprint, -imprint.maxValue);
-						map.FloodFillInfluence(currentLocation, imprint, imprint.maxValue);
-					}
-					ON_THREAD(map.UnlockMutex());
-				}
+		std::shared_ptr<const UserSnapshot> replaced = std::atomic_exchange(&myPublishedUsers, std::shared_ptr<const UserSnapshot>(snapshot));
+		myRecycledUsers = std::const_pointer_cast<UserSnapshot>(replaced);
+	}
+	void HeatmapManager::SyncPositions()
+	{
+		// The only place transforms are read, repaints on the workers only see this copy.
+		for (int user = 0; user < myUsers.GetCount(); user++)
+		{
+			const InfluenceComponent* component = myUsers.myComponents[user];
+			Vector3f position = component->myPosition;
+			Vector3f futurePosition = myUsers.myDynamic[user] ? position + *component->myVelocity : position;
+
+			myUsers.myPositionX[user] = position.x;
+			myUsers.myPositionZ[user] = position.z;
+			myUsers.myFuturePositionX[user] = futurePosition.x;
+			myUsers.myFuturePositionZ[user] = futurePosition.z;
+		}
+	}
+	void HeatmapManager::ComputeUserCells()
+	{
+		// Cells for every user in two batched passes over the packed positions.
+		UserRegistry& users = myUsers;
+		int userCount = users.GetCount();
+		simd::PositionsToCells(users.myPositionX.data(), users.myPositionZ.data(), userCount, myMin.x, myMin.y, myCellSize, users.myCellX.data(), users.myCellY.data());
+		simd::PositionsToCells(users.myFuturePositionX.data(), users.myFuturePositionZ.data(), userCount, myMin.x, myMin.y, myCellSize, users.myFutureCellX.data(), users.myFutureCellY.data());
+	}
+	void HeatmapManager::GatherUserRepaint(const int aUser)
+	{
+		UserRegistry& users = myUsers;
+		Vector2i currentLocation = { users.myCellX[aUser], users.myCellY[aUser] };
+		Vector2i& location = users.myLocations[aUser];
+
+		// We only update if the user has moved.
+		if (location == currentLocation) return;
+		users.myFootprintsChanged[aUser] = 1;
+
+		Team team = users.myTeams[aUser];
+		const InfluenceData* imprints = &users.myImprints[aUser * UserRegistry::ImprintStride];
 
-				user->location = currentLocation;
-				user->futureLocation = futureLocation;
+		// Dynamic users can apply influence on their future location as well, everyone else keeps it on their location.
+		Vector2i futureLocation = currentLocation;
+		if (users.myDynamic[aUser])
+		{
+			// Limit future location within the grid bounds.
+			futureLocation = { users.myFutureCellX[aUser], users.myFutureCellY[aUser] };
+			futureLocation.x = std::clamp(futureLocation.x, 0, myGridSize.x - 1);
+			futureLocation.y = std::clamp(futureLocation.y, 0, myGridSize.y - 1);
+		}
+
+		for (int type = 0; type < UserRegistry::ImprintStride; type++)
+		{
+			const InfluenceData& imprint = imprints[type];
+			if (imprint.type == HeatType::COUNT) continue;
+
+			// Layers rebuilt this tick paint everyone at once afterwards.
+			int layer = GetLayerIndex(team, imprint.type);
+			if (myLayerRebuilds[layer] != LayerRebuild::None) continue;
+
+			// [TODO] -> Imprints should tell if the influence should be applied to future location or not.
+			auto& bucket = myRepaintBuckets[layer];
+			bool keepFootprint = KeepsFootprint(imprint);
+			Footprint* footprint = keepFootprint ? &users.GetFootprint(aUser, imprint.type) : nullptr;
+
+			if (imprint.type == HeatType::Location)
+			{
+				Footprint* futureFootprint = keepFootprint ? &users.GetFootprint(aUser, imprint.type, true) : nullptr;
+				bucket.push_back({ &imprint, footprint, location, currentLocation, 0.5f });
+				bucket.push_back({ &imprint, futureFootprint, users.myFutureLocations[aUser], futureLocation, 0.5f });
 			}
 			else
 			{
-				for (auto& imprint : user->myImprints)
-				{
-					HeatTemplate& heatTemplate = GetImprintTemplate(imprint);
+				bucket.push_back({ &imprint, footprint, location, currentLocation, imprint.maxValue });
+			}
+		}
+
+		location = currentLocation;
+		users.myFutureLocations[aUser] = futureLocation;
+	}
+	void HeatmapManager::PaintRepaintBuckets()
+	{
+		// Buckets are split into chunks so one busy layer can spread over several threads.
+		// Stamps lock only the tiles they cover, chunks painting different regions of a layer never wait on each other.
+		myRepaintTasks.clear();
+		for (int layer = 0; layer < LayerCount; layer++)
+		{
+			int jobCount = static_cast<int>(myRepaintBuckets[layer].size());
+
+			for (int begin = 0; begin < jobCount; begin += myRepaintChunkSize)
+			{
+				myRepaintTasks.push_back({ layer, begin, std::min(jobCount, begin + myRepaintChunkSize) });
+			}
+		}
+
+		auto paintChunk = [this](int aTask)
+		{
+			const RepaintTask& task = myRepaintTasks[aTask];
+			const auto& bucket = myRepaintBuckets[task.layer];
+			Heatmap* map = GetHeatmap(GetLayerTeam(task.layer), GetLayerType(task.layer));
+
+			if (!map) return;
+
+			for (int i = task.begin; i < task.end; i++)
+			{
+				map->MoveInfluence(bucket[i].from, bucket[i].to, *bucket[i].imprint, bucket[i].amount, bucket[i].footprint);
+			}
+		};
+
+		int taskCount = static_cast<int>(myRepaintTasks.size());
+		if (myParallelRepaint)
+		{
+			myWorkerPool.ParallelFor(taskCount, paintChunk);
+		}
+		else
+		{
+			for (int task = 0; task < taskCount; task++)
+			{
+				paintChunk(task);
+			}
+		}
+
+		// Moves are gathered per layer first, every layer is its own buffer and can be painted independently.
+		for (auto& bucket : myRepaintBuckets)
+		{
+			bucket.clear();
+		}
+	}
+	void HeatmapManager::RepaintInfluence()
+	{
+		myThreadWorking.store(true, std::memory_order_release);
+
+		ComputeUserCells();
+		UpdatePaintModes();
+
+		for (int user = 0; user < myUsers.GetCount(); user++)
+		{
+			GatherUserRepaint(user);
+		}
+
+		PaintRepaintBuckets();
+		RebuildLayers();
+		PublishLayers();
+
+		myThreadWorking.store(false, std::memory_order_release);
+	}
+	void HeatmapManager::SetRepaintBudget(const float aMicroseconds)
+	{
+		myWorkerPool.Wait();
+		myRepaintBudget = std::max(0.0f, aMicroseconds);
+
+		// Budgeted repaints paint move by move, convolved layers go back to flood fills.
+		if (myRepaintBudget > 0.0f)
+		{
+			for (int layer = 0; layer < LayerCount; layer++)
+			{
+				if (!myConvolving[layer]) continue;
 
-					container[imprint.type]->FloodFillInfluence(user->location, imprint, -imprint.maxValue);
-					container[imprint.type]->FloodFillInfluence(currentLocation, imprint, imprint.maxValue);
+				myConvolving[layer] = false;
+				myLayerRebuilds[layer] = LayerRebuild::FloodFill;
+			}
+
+			RebuildLayers();
+			PublishLayers();
+		}
+
+		// Moves still queued get painted by the first full repaint, or picked up again on the next tick.
+		for (const ScheduledRepaint& scheduled : myScheduledRepaints)
+		{
+			int user = myUsers.Find(scheduled.user);
+			if (user >= 0) myUsers.myScheduledAt[user] = -1.0f;
+		}
+		myScheduledRepaints.clear();
+		myRepaintBacklog.fill({});
+	}
+	void HeatmapManager::SetConvolveThreshold(Team aTeam, HeatType aType, const int aMovedUsers)
+	{
+		myWorkerPool.Wait();
+		myConvolveThresholds[GetLayerIndex(aTeam, aType)] = std::max(0, aMovedUsers);
+	}
+	void HeatmapManager::UpdatePaintModes()
+	{
+		bool anyConvolve = false;
+		for (int layer = 0; layer < LayerCount; layer++)
+		{
+			anyConvolve |= myConvolveThresholds[layer] > 0 || myConvolving[layer];
+		}
+		if (!anyConvolve) return;
+
+		myMovedUsers.fill(0);
+		for (int user = 0; user < myUsers.GetCount(); user++)
+		{
+			if (myUsers.myLocations[user] == Vector2i(myUsers.myCellX[user], myUsers.myCellY[user])) continue;
+
+			for (int type = 0; type < UserRegistry::ImprintStride; type++)
+			{
+				if (myUsers.GetImprint(user, static_cast<HeatType>(type)).type == HeatType::COUNT) continue;
+
+				myMovedUsers[GetLayerIndex(myUsers.myTeams[user], static_cast<HeatType>(type))]++;
+			}
+		}
+
+		for (int layer = 0; layer < LayerCount; layer++)
+		{
+			int threshold = myConvolveThresholds[layer];
+			int moved = myMovedUsers[layer];
+
+			// Leaving only well below the threshold keeps a crowd hovering around it from flipping modes every tick.
+			if (myConvolving[layer])
+			{
+				if (threshold <= 0 || moved < threshold / 2)
+				{
+					myConvolving[layer] = false;
+					myLayerRebuilds[layer] = LayerRebuild::FloodFill;
 				}
+				else if (moved > 0)
+				{
+					myLayerRebuilds[layer] = LayerRebuild::Convolve;
+				}
+			}
+			else if (threshold > 0 && moved >= threshold)
+			{
+				// The flood filled values are thrown away, so are the footprints describing them.
+				myConvolving[layer] = true;
+				myLayerRebuilds[layer] = LayerRebuild::Convolve;
+				ClearLayerFootprints(layer);
+			}
+		}
+	}
+	void HeatmapManager::RebuildLayers()
+	{
+		// Rebuilt layers repaint their team's footprints, flagged here since the layers run in parallel.
+		for (int layer = 0; layer < LayerCount; layer++)
+		{
+			if (myLayerRebuilds[layer] == LayerRebuild::None) continue;
 
-				user->location = currentLocation;
+			for (int user = 0; user < myUsers.GetCount(); user++)
+			{
+				if (myUsers.myTeams[user] == GetLayerTeam(layer)) myUsers.myFootprintsChanged[user] = 1;
 			}
 		}
 
-		myThreadWorking = false;
-		myTimer = 0.0f;
+		myWorkerPool.ParallelFor(LayerCount, [this](int aLayer)
+		{
+			switch (myLayerRebuilds[aLayer])
+			{
+			case LayerRebuild::Convolve:
+				ConvolveLayer(aLayer);
+				break;
+
+			case LayerRebuild::FloodFill:
+				FloodFillLayer(aLayer);
+				break;
+
+			default:
+				break;
+			}
+
+			myLayerRebuilds[aLayer] = LayerRebuild::None;
+		});
+	}
+	void HeatmapManager::ConvolveLayer(const int aLayer)
+	{
+		Heatmap* map = GetHeatmap(GetLayerTeam(aLayer), GetLayerType(aLayer));
+		if (!map) return;
+
+		std::vector<ConvolveGroup>& groups = myConvolveGroups[aLayer];
+		for (ConvolveGroup& group : groups)
+		{
+			group.impulses.assign(myValidCells.size(), 0.0f);
+		}
+
+		auto splat = [&](std::vector<float>& aImpulses, const Vector2i& aCell, float aAmount)
+		{
+			if (aCell.x < 0 || aCell.y < 0 || aCell.x >= myGridSize.x || aCell.y >= myGridSize.y) return;
+			aImpulses[aCell.y * myGridSize.x + aCell.x] += aAmount;
+		};
+
+		for (int user = 0; user < myUsers.GetCount(); user++)
+		{
+			if (myUsers.myTeams[user] != GetLayerTeam(aLayer)) continue;
+
+			const InfluenceData& imprint = myUsers.GetImprint(user, GetLayerType(aLayer));
+			if (imprint.type == HeatType::COUNT) continue;
+
+			// Users sharing a curve and radius share one impulse grid and one convolution.
+			FalloffType curve = GetFalloffType(imprint);
+			int radius = GetCellRadius(imprint.radius);
+			auto group = std::find_if(groups.begin(), groups.end(), [&](const ConvolveGroup& aGroup)
+			{
+				return aGroup.curve == curve && aGroup.radius == radius;
+			});
+
+			if (group == groups.end())
+			{
+				groups.push_back({ curve, radius, GetSeparableKernel(curve, radius), std::vector<float>(myValidCells.size(), 0.0f) });
+				group = groups.end() - 1;
+			}
+
+			if (imprint.type == HeatType::Location)
+			{
+				splat(group->impulses, myUsers.myLocations[user], 0.5f);
+				splat(group->impulses, myUsers.myFutureLocations[user], 0.5f);
+			}
+			else
+			{
+				splat(group->impulses, myUsers.myLocations[user], imprint.maxValue);
+			}
+		}
+
+		map->ClearInfluence();
+		for (const ConvolveGroup& group : groups)
+		{
+			map->ConvolveInfluence(group.impulses, *group.kernel);
+		}
+		map->MaskInvalidCells();
+	}
+	void HeatmapManager::FloodFillLayer(const int aLayer)
+	{
+		Heatmap* map = GetHeatmap(GetLayerTeam(aLayer), GetLayerType(aLayer));
+		if (!map) return;
+
+		map->ClearInfluence();
+		for (int user = 0; user < myUsers.GetCount(); user++)
+		{
+			if (myUsers.myTeams[user] != GetLayerTeam(aLayer)) continue;
+
+			const InfluenceData& imprint = myUsers.GetImprint(user, GetLayerType(aLayer));
+			if (imprint.type == HeatType::COUNT) continue;
+
+			PaintImprint(*map, user, imprint);
+		}
+	}
+	void HeatmapManager::ClearLayerFootprints(const int aLayer)
+	{
+		for (int user = 0; user < myUsers.GetCount(); user++)
+		{
+			if (myUsers.myTeams[user] != GetLayerTeam(aLayer)) continue;
+
+			myUsers.GetFootprint(user, GetLayerType(aLayer)).Clear();
+			myUsers.GetFootprint(user, GetLayerType(aLayer), true).Clear();
+			myUsers.myFootprintsChanged[user] = 1;
+		}
+	}
+	std::shared_ptr<const SeparableKernel> HeatmapManager::GetSeparableKernel(const FalloffType aCurve, const int aCellRadius)
+	{
+		unsigned long long key = (static_cast<unsigned long long>(aCurve) << 32) | static_cast<unsigned int>(aCellRadius);
+		std::lock_guard<std::mutex> lock(myKernelMutex);
+
+		auto it = myKernels.find(key);
+		if (it != myKernels.end()) return it->second;
+
+		std::shared_ptr<const SeparableKernel> kernel = SeparableKernel::Create(*myTemplateCache.Get(aCurve, aCellRadius), myKernelTolerance);
+		myKernels.insert({ key, kernel });
+		return kernel;
+	}
+	void HeatmapManager::ScheduleRepaints()
+	{
+		ComputeUserCells();
+		myRepaintTick.fetch_add(1, std::memory_order_relaxed);
+
+		// A user already waiting keeps its place, it is painted at wherever it is once its turn comes.
+		for (int user = 0; user < myUsers.GetCount(); user++)
+		{
+			if (myUsers.myScheduledAt[user] >= 0.0f) continue;
+			if (myUsers.myLocations[user] == Vector2i(myUsers.myCellX[user], myUsers.myCellY[user])) continue;
+
+			myUsers.myScheduledAt[user] = myTime;
+			myScheduledRepaints.push_back({ myUsers.GetHandle(user), 0.0f });
+		}
+	}
+	void HeatmapManager::RunScheduledRepaints()
+	{
+		using Clock = std::chrono::steady_clock;
+		Clock::time_point start = Clock::now();
+		unsigned int tick = myRepaintTick.load(std::memory_order_relaxed);
+
+		// Stalest first, a user standing where agents queried this tick or the last counts as older than it is.
+		size_t kept = 0;
+		for (size_t i = 0; i < myScheduledRepaints.size(); i++)
+		{
+			ScheduledRepaint scheduled = myScheduledRepaints[i];
+			int user = myUsers.Find(scheduled.user);
+			if (user < 0) continue;
+
+			Vector2i tile = { myUsers.myCellX[user] / Heatmap::TileSize, myUsers.myCellY[user] / Heatmap::TileSize };
+			bool nearQuery = false;
+			if (tile.x >= 0 && tile.y >= 0 && tile.x < myQueryTileCount.x && tile.y < myQueryTileCount.y)
+			{
+				unsigned int queried = myQueryTiles[tile.y * myQueryTileCount.x + tile.x].load(std::memory_order_relaxed);
+				nearQuery = queried != 0 && queried + 1 >= tick;
+			}
+
+			scheduled.priority = (myTime - myUsers.myScheduledAt[user]) + (nearQuery ? myQueryPriorityBoost : 0.0f);
+			myScheduledRepaints[kept++] = scheduled;
+		}
+		myScheduledRepaints.resize(kept);
+		std::make_heap(myScheduledRepaints.begin(), myScheduledRepaints.end());
+
+		// At least one batch per frame, so a budget below the cost of a batch still makes progress.
+		bool painted = false;
+		const std::chrono::duration<float, std::micro> budget(myRepaintBudget);
+		while (!myScheduledRepaints.empty() && (!painted || Clock::now() - start < budget))
+		{
+			for (int batch = 0; batch < myScheduledBatchSize && !myScheduledRepaints.empty(); batch++)
+			{
+				std::pop_heap(myScheduledRepaints.begin(), myScheduledRepaints.end());
+				int user = myUsers.Find(myScheduledRepaints.back().user);
+				myScheduledRepaints.pop_back();
+
+				myUsers.myScheduledAt[user] = -1.0f;
+				GatherUserRepaint(user);
+			}
+
+			PaintRepaintBuckets();
+			painted = true;
+		}
+
+		if (painted)
+		{
+			PublishLayers();
+		}
+
+		// What is left over, per layer the user's imprints go into.
+		myRepaintBacklog.fill({});
+		for (const ScheduledRepaint& scheduled : myScheduledRepaints)
+		{
+			int user = myUsers.Find(scheduled.user);
+			float age = myTime - myUsers.myScheduledAt[user];
+
+			for (int type = 0; type < UserRegistry::ImprintStride; type++)
+			{
+				if (myUsers.GetImprint(user, static_cast<HeatType>(type)).type == HeatType::COUNT) continue;
+
+				RepaintBacklog& backlog = myRepaintBacklog[GetLayerIndex(myUsers.myTeams[user], static_cast<HeatType>(type))];
+				backlog.pendingMoves++;
+				backlog.oldestSeconds = std::max(backlog.oldestSeconds, age);
+			}
+		}
+	}
+	void HeatmapManager::MarkQueryRegion(const Vector2i& aOrigin, const int aRadius)
+	{
+		if (!myQueryTiles) return;
+
+		Vector2i tileMin = { std::max(0, aOrigin.x - aRadius) / Heatmap::TileSize, std::max(0, aOrigin.y - aRadius) / Heatmap::TileSize };
+		Vector2i tileMax = { std::min(myGridSize.x - 1, aOrigin.x + aRadius) / Heatmap::TileSize, std::min(myGridSize.y - 1, aOrigin.y + aRadius) / Heatmap::TileSize };
+		unsigned int tick = myRepaintTick.load(std::memory_order_relaxed);
+
+		for (int y = tileMin.y; y <= tileMax.y; y++)
+		{
+			for (int x = tileMin.x; x <= tileMax.x; x++)
+			{
+				myQueryTiles[y * myQueryTileCount.x + x].store(tick, std::memory_order_relaxed);
+			}
+		}
 	}
 
 	void HeatmapManager::Reset()
 	{
-		myUsers.clear();
-		myUsersToAdd.clear();
-		myImprintTemplates.clear();
-		myInterestTemplates.clear();
+		// Never pull the maps and users out from under a repaint that is still running.
+		myWorkerPool.Wait();
+
+		myUsers.Clear();
+		myStaticUsers.Clear();
+		myUserHandles.clear();
+		myStaticLayersDirty.fill(false);
+		myRegistrations.Drain(myPendingRegistrations);
+		myPendingRegistrations.clear();
+		myScheduledRepaints.clear();
+		myRepaintBacklog.fill({});
+		myConvolving.fill(false);
+		myLayerRebuilds.fill(LayerRebuild::None);
+		myKernels.clear();
+		myTemplateCache.Clear();
 		myInfluenceMaps.clear();
+		myQueryCache.Clear();
+		myReachabilityCache.Clear();
+		myBakeFile.Close();
+		std::atomic_store(&myPublishedUsers, std::shared_ptr<const UserSnapshot>());
+		myRecycledUsers.reset();
 	}
 
 #pragma region Debug
@@ -414,11 +1550,12 @@ namespace AI
 		if (container.find(aType) == container.end()) { return; }
 
 		auto& map = container.at(aType);
+		std::shared_ptr<const HeatmapSnapshot> snapshot = map->GetSnapshot();
 
 		Vector2i cord = {};
 		Vector2f cellCenter = {};
 
-		for (int i = 0; i < map->myValues.size(); ++i)
+		for (int i = 0; i < myGridSize.x * myGridSize.y; ++i)
 		{
 			if (!myValidCells[i]) {
 
@@ -432,7 +1569,7 @@ namespace AI
 				myMin.y + ((cord.y + 0.5f) * myCellSize) - 10.f
 			};
 
-			Vector4f debugColor = debug::GetHeatColor(map->myValues[i], aType, aTeam);
+			Vector4f debugColor = debug::GetHeatColor(snapshot->GetValue(cord.y, cord.x), aType, aTeam);
 
 			myHeatSpriteBatch.myInstances[i].myAttributes.myColor = { debugColor.x, debugColor.y, debugColor.z, debugColor.w };
 		}
@@ -503,6 +1640,7 @@ namespace AI
 
 		KE::TextureLoader* textureLoader = KE_GLOBAL::blackboard.Get<KE::TextureLoader>("textureLoader");
 		myHeatSpriteBatch.myData.myTexture = textureLoader->GetTextureFromPath("Data/EngineAssets/KEDefault_c.dds");
+		myWorkMap.InitDebug();
 		myHeatSpriteBatch.myInstances.reserve(8192);
 		myHeatSpriteBatch.myData.myMode = KE::SpriteBatchMode::Default;
 		myHeatSpriteBatch.myInstances.resize(cellCount);
@@ -5,6 +5,15 @@
 #include <Engine/Source/AI/HeatmapSystem/InfluenceComponent.h>
 #include <Engine/Source/AI/HeatmapSystem/HeatmapCommonData.h>
 #include <Engine/Source/AI/HeatmapSystem/Workmap.h>
+#include <Engine/Source/AI/HeatmapSystem/WorkerPool.h>
+#include <Engine/Source/AI/HeatmapSystem/WorkmapPool.h>
+#include <Engine/Source/AI/HeatmapSystem/QueryCache.h>
+#include <Engine/Source/AI/HeatmapSystem/ReachabilityCache.h>
+#include <Engine/Source/AI/HeatmapSystem/TemplateCache.h>
+#include <Engine/Source/AI/HeatmapSystem/UserRegistry.h>
+#include <Engine/Source/AI/HeatmapSystem/RegistrationQueue.h>
+#include <Engine/Source/AI/HeatmapSystem/SeparableKernel.h>
+#include <Engine/Source/AI/HeatmapSystem/HeatmapBake.h>
 #include "Heatmap.h"
 
 #define DEBUG_ACTIVE
@@ -55,6 +64,57 @@ namespace AI
 		Team textTeam = Team::Enemy;
 	};
 
+	// A pending move of one imprint, painted by the thread that owns the imprint's layer.
+	struct RepaintJob
+	{
+		const InfluenceData* imprint = nullptr;
+		Footprint* footprint = nullptr; // Set when the imprint keeps its footprint.
+		Vector2i from;
+		Vector2i to;
+		float amount = 0.0f;
+	};
+
+	// A user waiting for its move to be painted when repaints run on a frame budget.
+	struct ScheduledRepaint
+	{
+		UserHandle user;
+		float priority = 0.0f;
+
+		inline bool operator<(const ScheduledRepaint& aOther) const { return priority < aOther.priority; }
+	};
+
+	// How far a layer is behind the users painted into it.
+	struct RepaintBacklog
+	{
+		int pendingMoves = 0;
+		float oldestSeconds = 0.0f; // Time since the oldest pending move was seen.
+	};
+
+	// How a layer is painted this tick when it isn't painted move by move.
+	enum class LayerRebuild
+	{
+		None,
+		Convolve,
+		FloodFill
+	};
+
+	// Every user of one imprint shape in a convolved layer, splatted as one amount per cell.
+	struct ConvolveGroup
+	{
+		FalloffType curve = FalloffType::COUNT;
+		int radius = 0;
+		std::shared_ptr<const SeparableKernel> kernel;
+		std::vector<float> impulses;
+	};
+
+	// A slice of one layer's repaint bucket, the unit of work handed to the worker pool.
+	struct RepaintTask
+	{
+		int layer = 0;
+		int begin = 0;
+		int end = 0;
+	};
+
 	class HeatmapManager
 	{
 		KE_EDITOR_FRIEND;
@@ -66,15 +126,73 @@ namespace AI
 		HeatmapManager();
 		~HeatmapManager();
 		bool Init(float aCellSize, Vector2f aMin, Vector2f aMax);
+		// Starts from a bake written by SaveBake instead of building the grid, valid cells and templates, and uses
+		// its static layers as the level's static base. Returns false when the file is missing, damaged, of another
+		// version or baked for another navmesh. Replaces both Init and InitValidCells.
+		bool Init(const std::string& aBakePath, const unsigned long long aNavmeshHash);
+		// Offline step, after Init, InitValidCells and registering the static level features. aStaticLayers also
+		// stores the static base of every layer that has one, those features should not register again at runtime.
+		bool SaveBake(const std::string& aPath, const unsigned long long aNavmeshHash, const bool aStaticLayers);
 		void InitValidCells(KE::Navmesh& aNavmesh);
+		// Scan converts navmesh triangles into the valid cells instead of testing every cell center against the
+		// navmesh. Same result as the point test, except that centers exactly on an outer edge always count.
+		// Positions are world space with y ignored, three indices per triangle. Both overloads split the rows into
+		// bands over the worker threads.
+		void InitValidCells(const std::vector<Vector3f>& aVertices, const std::vector<int>& aIndices);
 		void Reset();
 		void Update();
 		void LateUpdate();
+		// Safe to call from any thread, takes effect on the next Update. The user can be destroyed as soon as
+		// DeRegister returns, the queued call is applied without touching it.
 		void Register(InfluenceComponent& aUser);
 		void DeRegister(InfluenceComponent& aUser);
+		inline void SetParallelRepaint(const bool aParallel) { myParallelRepaint = aParallel; }
+		// Spreads repaints over frames instead of painting every move once per tick. Moves are still picked up once
+		// per tick, then painted stalest first, and near recent queries first, until aMicroseconds is spent.
+		// Whatever is left carries over to the next frame. 0 paints everything on the tick.
+		void SetRepaintBudget(const float aMicroseconds);
+		inline const RepaintBacklog& GetRepaintBacklog(Team aTeam, HeatType aType) const { return myRepaintBacklog[GetLayerIndex(aTeam, aType)]; }
+		// A layer with at least aMovedUsers moving users in a tick is rebuilt by convolving every user's imprint
+		// instead of flood filling each move, and goes back to flood fills once fewer than half that many move.
+		// Convolving costs the same for any number of users, it grows with the layer area instead, but only masks
+		// obstacles, see Heatmap::ConvolveInfluence. 0 never convolves. Only used by the tick repaint, not with a
+		// repaint budget.
+		void SetConvolveThreshold(Team aTeam, HeatType aType, const int aMovedUsers);
+		inline bool IsConvolving(Team aTeam, HeatType aType) const { return myConvolving[GetLayerIndex(aTeam, aType)]; }
+		// Batched queries share results between agents in the same cell while the layers they read are unchanged.
+		inline void SetQueryCaching(const bool aCaching) { myQueryCaching = aCaching; }
+		inline QueryCache& GetQueryCache() { return myQueryCache; }
+		// Flood fills up to ReachabilityCache::MaxRadius stamp a cached mask of the cells they reach instead of walking them.
+		inline ReachabilityCache& GetReachabilityCache() { return myReachabilityCache; }
+		// Keeps summed-area tables and min/max pyramids on every layer. Needed for the region queries to be fast and
+		// for workmaps to bound their search, call after Init.
+		void SetRegionQueries(const bool aEnabled);
+		// Every layer only allocates the tiles influence is painted into, see Heatmap::SetSparse. Call before Init to
+		// never allocate full layers at all.
+		void SetSparseLayers(const bool aSparse);
+		// Rounds what is painted into one layer to aStep and publishes it as int16, see Heatmap::SetQuantization.
+		// Kept across Init, 0 turns it off.
+		void SetLayerQuantization(Team aTeam, HeatType aType, const float aStep);
+		// Imprints up to this radius in cells remember what they painted, so moving and removing them never flood
+		// fills the old position. Costs one float and a bit per painted cell, -1 keeps every footprint, 0 none.
+		void SetFootprintRadius(const int aCellRadius);
 
 		Workmap* GetWorkmap(const Vector3f& aPosition, const int aRadius);
+		// Thread-safe alternative to GetWorkmap, every handle owns its own workmap until it is released.
+		WorkmapHandle AcquireWorkmap(const Vector3f& aPosition, const int aRadius);
+		// Evaluates every query across the worker pool and writes the best position of query i to aOutPositions[i].
+		// Not reentrant, the sort order is kept in manager owned scratch.
+		void EvaluateQueries(const std::vector<WorkmapQuery>& aQueries, std::vector<Vector3f>& aOutPositions);
 		float GetValueAtLocation(const Vector3f aPos, Team aTeam, HeatType aType);
+		// Users as of the last publish, the same one the layers' snapshots come from. Safe to read from any thread.
+		inline std::shared_ptr<const UserSnapshot> GetUserSnapshot() const { return std::atomic_load(&myPublishedUsers); }
+		// Cells a registered user is painted at, false if the user isn't registered.
+		bool GetUserCells(const InfluenceComponent& aUser, Vector2i& aOutLocation, Vector2i& aOutFutureLocation) const;
+		// What a user's imprint adds to its layer, nullptr when it isn't recorded.
+		std::shared_ptr<const Footprint> GetUserFootprint(const InfluenceComponent& aUser, HeatType aType, const bool aFuture = false) const;
+		// Total and highest value of a layer inside the world space box spanned by aMin and aMax (x and z).
+		float GetRegionSum(const Vector3f& aMin, const Vector3f& aMax, Team aTeam, HeatType aType);
+		float GetRegionMax(const Vector3f& aMin, const Vector3f& aMax, Team aTeam, HeatType aType);
 
 #pragma region DEBUG
 		inline DebugInfo& GetDebugInfo() { return myDebug; }	
@@ -85,15 +203,58 @@ namespace AI
 #pragma endregion
 
 	private:
-		void RemoveUser(InfluenceComponent* aUser);
+		// Works from the registry alone, the component may already be destroyed when its DeRegister is drained.
+		void RemoveUser(const UserHandle& aHandle);
 		void AddUser(InfluenceComponent* aUser);
 		void RegistrationUpdate();
+		// Rebuilds the static base of every layer a static user was added to or removed from.
+		void BakeStaticLayers();
 		void RepaintInfluence();
+		// Cells of every moving user from the synced positions.
+		void ComputeUserCells();
+		// Queues the moves of a user into the repaint buckets and moves its cells to where it is now.
+		void GatherUserRepaint(const int aUser);
+		void PaintRepaintBuckets();
+		// Picks flood fill or convolve for every layer from how many of its users moved.
+		void UpdatePaintModes();
+		void RebuildLayers();
+		void ConvolveLayer(const int aLayer);
+		void FloodFillLayer(const int aLayer);
+		// Paints a moving user's imprint at its current cells, recording footprints where they are kept.
+		void PaintImprint(Heatmap& aMap, const int aUser, const InfluenceData& aImprint);
+		void ClearLayerFootprints(const int aLayer);
+		std::shared_ptr<const SeparableKernel> GetSeparableKernel(const FalloffType aCurve, const int aCellRadius);
+		void ScheduleRepaints();
+		void RunScheduledRepaints();
+		// Flags the tiles a query looks at, users there are repainted first.
+		void MarkQueryRegion(const Vector2i& aOrigin, const int aRadius);
+		// Copies positions and velocities of moving users into the registry, on the game thread before a repaint.
+		void SyncPositions();
+		// Publishes every layer and the users with them.
+		void PublishLayers();
+		void PublishUsers();
+		void InitGrid(float aCellSize, Vector2f aMin, Vector2f aMax);
+		void InitLayers();
 		void CreateTemplates();
-		void InitTemplate(const int aSize, FalloffFunction aFallofCurve, HeatTemplate& aTemplate);
+		// Packs the rows filled in by InitValidCells into the valid cells and drops everything derived from the old ones.
+		void StoreValidCells();
+		void InitWorkmap(Workmap& aWorkmap, const Vector3f& aPosition, const int aRadius);
+		Vector3f EvaluateQuery(Workmap& aWorkmap, const WorkmapQuery& aQuery);
+		// Fills aOutRecipe with the query's steps and returns their hash.
+		size_t BuildQueryRecipe(const WorkmapQuery& aQuery, std::vector<QueryOperation>& aOutRecipe) const;
+		void GetQueryVersions(const WorkmapQuery& aQuery, const Vector2i& aOrigin, std::vector<unsigned long long>& aOutVersions);
+		// World radius of an imprint in whole cells, never less than one cell for a non-zero radius.
+		int GetCellRadius(const int aRadius) const;
+		inline bool KeepsFootprint(const InfluenceData& aImprint) const
+		{
+			return myFootprintRadius < 0 || GetCellRadius(aImprint.radius) <= myFootprintRadius;
+		}
 
-		HeatTemplate& GetImprintTemplate(const InfluenceData& aImprintData);
-		HeatTemplate& GetInterestTemplate(const int aRadius);
+		std::shared_ptr<const HeatTemplate> GetImprintTemplate(const InfluenceData& aImprintData);
+		std::shared_ptr<const HeatTemplate> GetInterestTemplate(const int aRadius);
+		static FloodFillScratch& GetFloodFillScratch();
+		// Null when the fill can't use a mask: origin off the grid or radius too large.
+		std::shared_ptr<const ReachMask> GetReachMask(const Vector2i& aOrigin, const int aCellRadius);
 		Heatmap* GetHeatmap(Team aTeam, HeatType aType);
 		inline Vector3f GetPosByIndex(const int aIndex) const;
 		inline Vector2i GetCoordinate(const Vector3f& aPos) const;
@@ -101,26 +262,66 @@ namespace AI
 
 	private:
 		Workmap myWorkMap;
+		WorkmapPool myWorkmapPool;
 		Vector2f myMin;
 		Vector2f myMax;
 		Vector2i myGridSize;
 		Vector2i myWorldOrigin;
 		float myCellSize = 0.0f;
 		float myTimer = 0.0f;
+		float myTime = 0.0f;
 		float myUpdateFrequency = 0.1f;
-		const int myTemplateMaxSize = 10;
+		const int myPrebuiltTemplateSize = 10;
 		
 		std::vector<bool> myValidCells;
+		std::vector<unsigned char> myValidRows; // One byte per cell, bands of rows are filled in parallel and packed after.
+		std::vector<std::vector<int>> myBandTriangles;
+		const int myValidBandRows = 32;
 		std::unordered_map<Team, std::unordered_map<HeatType, Heatmap*>> myInfluenceMaps;
-		std::unordered_map<HeatType, std::vector<HeatTemplate>> myImprintTemplates;
-		std::vector<HeatTemplate> myInterestTemplates;
+		TemplateCache myTemplateCache;
 
-		std::vector<InfluenceComponent*> myUsers;
-		std::vector<InfluenceComponent*> myUsersToAdd;
-		std::vector<InfluenceComponent*> myUsersToRemove;
+		UserRegistry myUsers;
+		UserRegistry myStaticUsers;
+		std::unordered_map<const InfluenceComponent*, UserHandle> myUserHandles; // Registered users, looked up without touching the component.
+		std::array<bool, LayerCount> myStaticLayersDirty = {};
+		int myFootprintRadius = 16;
+		RegistrationQueue myRegistrations;
+		std::vector<Registration> myPendingRegistrations;
+		std::vector<size_t> myRegistrationOrder;
+		std::vector<size_t> myAddOrder;
 
-		bool myThreadWorking = false;
-		std::thread myRepaintThread;
+		std::atomic<bool> myThreadWorking = false;
+		std::shared_ptr<const UserSnapshot> myPublishedUsers;
+		std::shared_ptr<UserSnapshot> myRecycledUsers;
+		bool myParallelRepaint = true;
+		WorkerPool myWorkerPool;
+		const int myRepaintChunkSize = 32;
+		std::array<std::vector<RepaintJob>, LayerCount> myRepaintBuckets;
+		std::vector<RepaintTask> myRepaintTasks;
+		float myRepaintBudget = 0.0f;
+		const int myScheduledBatchSize = 16;
+		const float myQueryPriorityBoost = 0.1f; // Seconds of staleness a user near a recent query is worth.
+		std::vector<ScheduledRepaint> myScheduledRepaints;
+		std::array<RepaintBacklog, LayerCount> myRepaintBacklog = {};
+		Vector2i myQueryTileCount;
+		std::unique_ptr<std::atomic<unsigned int>[]> myQueryTiles; // Tick a query last looked at the tile.
+		std::atomic<unsigned int> myRepaintTick = 1;
+		std::array<int, LayerCount> myConvolveThresholds = {};
+		std::array<bool, LayerCount> myConvolving = {};
+		std::array<int, LayerCount> myMovedUsers = {};
+		std::array<LayerRebuild, LayerCount> myLayerRebuilds = {};
+		std::array<std::vector<ConvolveGroup>, LayerCount> myConvolveGroups;
+		const float myKernelTolerance = 1e-3f;
+		std::mutex myKernelMutex;
+		std::unordered_map<unsigned long long, std::shared_ptr<const SeparableKernel>> myKernels;
+		const int myQueryChunkSize = 16;
+		std::vector<std::pair<int, int>> myQueryOrder;
+		bool myQueryCaching = true;
+		bool mySparseLayers = false;
+		std::array<float, LayerCount> myLayerQuantization = {};
+		QueryCache myQueryCache;
+		ReachabilityCache myReachabilityCache;
+		MappedFile myBakeFile; // Open while the layers read their static base from it.
 
 		// <[DEBUG]> //
 		DebugInfo myDebug;
@@ -0,0 +1,510 @@
+#include "stdafx.h"
+#include "HeatmapSimd.h"
+#include <cmath>
+#include <limits>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define HEATMAP_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define HEATMAP_TARGET_AVX
+#else
+#define HEATMAP_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+namespace AI
+{
+	namespace simd
+	{
+		namespace
+		{
+			const float NegativeInfinity = -std::numeric_limits<float>::infinity();
+
+			struct Kernels
+			{
+				void (*addScaled)(float*, const float*, const float, const int);
+				void (*multiplyScaled)(float*, const float*, const float, const int);
+				void (*addScaledBlock)(float*, const int, const float*, const int, const float, const int, const int);
+				void (*multiplyScaledBlock)(float*, const int, const float*, const int, const float, const int, const int);
+				void (*scale)(float*, const float, const int);
+				float (*max)(const float*, const int);
+				float (*maxNonZeroProduct)(const float*, const float*, const int);
+				void (*positionsToCells)(const float*, const float*, const int, const float, const float, const float, int*, int*);
+				void (*addScaledQuantized)(float*, const short*, const float, const int);
+				void (*multiplyScaledQuantized)(float*, const short*, const float, const int);
+				void (*quantize)(const float*, const float, short*, const int);
+			};
+
+#pragma region Scalar
+
+			// The scalar loops also finish the tails of the vector kernels.
+			void AddScaledScalar(float* aValues, const float* aLayer, const float aScalar, const int aCount)
+			{
+				for (int i = 0; i < aCount; i++)
+				{
+					aValues[i] += aLayer[i] * aScalar;
+				}
+			}
+			void MultiplyScaledScalar(float* aValues, const float* aLayer, const float aScalar, const int aCount)
+			{
+				for (int i = 0; i < aCount; i++)
+				{
+					aValues[i] *= aLayer[i] * aScalar;
+				}
+			}
+			void AddScaledBlockScalar(float* aValues, const int aValuesStride, const float* aLayer, const int aLayerStride, const float aScalar, const int aCount, const int aRows)
+			{
+				for (int row = 0; row < aRows; row++)
+				{
+					AddScaledScalar(aValues + row * aValuesStride, aLayer + row * aLayerStride, aScalar, aCount);
+				}
+			}
+			void MultiplyScaledBlockScalar(float* aValues, const int aValuesStride, const float* aLayer, const int aLayerStride, const float aScalar, const int aCount, const int aRows)
+			{
+				for (int row = 0; row < aRows; row++)
+				{
+					MultiplyScaledScalar(aValues + row * aValuesStride, aLayer + row * aLayerStride, aScalar, aCount);
+				}
+			}
+			void ScaleScalar(float* aValues, const float aScalar, const int aCount)
+			{
+				for (int i = 0; i < aCount; i++)
+				{
+					aValues[i] *= aScalar;
+				}
+			}
+			float MaxScalar(const float* aValues, const int aCount, float aBest = NegativeInfinity)
+			{
+				for (int i = 0; i < aCount; i++)
+				{
+					aBest = std::max(aBest, aValues[i]);
+				}
+				return aBest;
+			}
+			float MaxNonZeroProductScalar(const float* aValues, const float* aWeights, const int aCount, float aBest = NegativeInfinity)
+			{
+				for (int i = 0; i < aCount; i++)
+				{
+					float product = aValues[i] * aWeights[i];
+					aBest = product != 0.0f ? std::max(aBest, product) : aBest;
+				}
+				return aBest;
+			}
+
+			void PositionsToCellsScalar(const float* aX, const float* aZ, const int aCount, const float aMinX, const float aMinZ, const float aCellSize, int* aOutX, int* aOutY)
+			{
+				for (int i = 0; i < aCount; i++)
+				{
+					aOutX[i] = static_cast<int>((aX[i] - aMinX) / aCellSize);
+					aOutY[i] = static_cast<int>((aZ[i] - aMinZ) / aCellSize);
+				}
+			}
+
+			void AddScaledQuantizedScalar(float* aValues, const short* aLayer, const float aScalar, const int aCount)
+			{
+				for (int i = 0; i < aCount; i++)
+				{
+					aValues[i] += aLayer[i] * aScalar;
+				}
+			}
+			void MultiplyScaledQuantizedScalar(float* aValues, const short* aLayer, const float aScalar, const int aCount)
+			{
+				for (int i = 0; i < aCount; i++)
+				{
+					aValues[i] *= aLayer[i] * aScalar;
+				}
+			}
+			void QuantizeScalar(const float* aValues, const float aInvStep, short* aOut, const int aCount)
+			{
+				for (int i = 0; i < aCount; i++)
+				{
+					float steps = std::nearbyint(aValues[i] * aInvStep);
+					aOut[i] = static_cast<short>(std::min(32767.0f, std::max(-32768.0f, steps)));
+				}
+			}
+
+#pragma endregion
+
+#ifdef HEATMAP_X86
+#pragma region SSE2
+
+			float HorizontalMax(__m128 aLanes)
+			{
+				alignas(16) float lanes[4];
+				_mm_store_ps(lanes, aLanes);
+				return std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+			}
+
+			void AddScaledSse(float* aValues, const float* aLayer, const float aScalar, const int aCount)
+			{
+				const __m128 scalar = _mm_set1_ps(aScalar);
+				int i = 0;
+				for (; i + 4 <= aCount; i += 4)
+				{
+					__m128 product = _mm_mul_ps(_mm_loadu_ps(aLayer + i), scalar);
+					_mm_storeu_ps(aValues + i, _mm_add_ps(_mm_loadu_ps(aValues + i), product));
+				}
+				AddScaledScalar(aValues + i, aLayer + i, aScalar, aCount - i);
+			}
+			void MultiplyScaledSse(float* aValues, const float* aLayer, const float aScalar, const int aCount)
+			{
+				const __m128 scalar = _mm_set1_ps(aScalar);
+				int i = 0;
+				for (; i + 4 <= aCount; i += 4)
+				{
+					__m128 product = _mm_mul_ps(_mm_loadu_ps(aLayer + i), scalar);
+					_mm_storeu_ps(aValues + i, _mm_mul_ps(_mm_loadu_ps(aValues + i), product));
+				}
+				MultiplyScaledScalar(aValues + i, aLayer + i, aScalar, aCount - i);
+			}
+			void AddScaledBlockSse(float* aValues, const int aValuesStride, const float* aLayer, const int aLayerStride, const float aScalar, const int aCount, const int aRows)
+			{
+				for (int row = 0; row < aRows; row++)
+				{
+					AddScaledSse(aValues + row * aValuesStride, aLayer + row * aLayerStride, aScalar, aCount);
+				}
+			}
+			void MultiplyScaledBlockSse(float* aValues, const int aValuesStride, const float* aLayer, const int aLayerStride, const float aScalar, const int aCount, const int aRows)
+			{
+				for (int row = 0; row < aRows; row++)
+				{
+					MultiplyScaledSse(aValues + row * aValuesStride, aLayer + row * aLayerStride, aScalar, aCount);
+				}
+			}
+			void ScaleSse(float* aValues, const float aScalar, const int aCount)
+			{
+				const __m128 scalar = _mm_set1_ps(aScalar);
+				int i = 0;
+				for (; i + 4 <= aCount; i += 4)
+				{
+					_mm_storeu_ps(aValues + i, _mm_mul_ps(_mm_loadu_ps(aValues + i), scalar));
+				}
+				ScaleScalar(aValues + i, aScalar, aCount - i);
+			}
+			float MaxSse(const float* aValues, const int aCount)
+			{
+				__m128 best = _mm_set1_ps(NegativeInfinity);
+				int i = 0;
+				for (; i + 4 <= aCount; i += 4)
+				{
+					best = _mm_max_ps(best, _mm_loadu_ps(aValues + i));
+				}
+				return MaxScalar(aValues + i, aCount - i, HorizontalMax(best));
+			}
+			float MaxNonZeroProductSse(const float* aValues, const float* aWeights, const int aCount)
+			{
+				const __m128 zero = _mm_setzero_ps();
+				const __m128 negInf = _mm_set1_ps(NegativeInfinity);
+				__m128 best = negInf;
+				int i = 0;
+				for (; i + 4 <= aCount; i += 4)
+				{
+					// Zero products are swapped for -infinity with a mask instead of a branch.
+					__m128 product = _mm_mul_ps(_mm_loadu_ps(aValues + i), _mm_loadu_ps(aWeights + i));
+					__m128 nonZero = _mm_cmpneq_ps(product, zero);
+					__m128 candidate = _mm_or_ps(_mm_and_ps(nonZero, product), _mm_andnot_ps(nonZero, negInf));
+					best = _mm_max_ps(best, candidate);
+				}
+				return MaxNonZeroProductScalar(aValues + i, aWeights + i, aCount - i, HorizontalMax(best));
+			}
+			void PositionsToCellsSse(const float* aX, const float* aZ, const int aCount, const float aMinX, const float aMinZ, const float aCellSize, int* aOutX, int* aOutY)
+			{
+				// A real divide rather than a reciprocal, cells on the boundary must truncate the same way as the scalar path.
+				const __m128 minX = _mm_set1_ps(aMinX);
+				const __m128 minZ = _mm_set1_ps(aMinZ);
+				const __m128 cellSize = _mm_set1_ps(aCellSize);
+				int i = 0;
+				for (; i + 4 <= aCount; i += 4)
+				{
+					__m128i cellX = _mm_cvttps_epi32(_mm_div_ps(_mm_sub_ps(_mm_loadu_ps(aX + i), minX), cellSize));
+					__m128i cellY = _mm_cvttps_epi32(_mm_div_ps(_mm_sub_ps(_mm_loadu_ps(aZ + i), minZ), cellSize));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(aOutX + i), cellX);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(aOutY + i), cellY);
+				}
+				PositionsToCellsScalar(aX + i, aZ + i, aCount - i, aMinX, aMinZ, aCellSize, aOutX + i, aOutY + i);
+			}
+
+			// Sign extends eight int16 steps to two float lanes.
+			inline void DecodeSse(const short* aLayer, __m128& aOutLow, __m128& aOutHigh)
+			{
+				__m128i steps = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aLayer));
+				aOutLow = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(steps, steps), 16));
+				aOutHigh = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(steps, steps), 16));
+			}
+			void AddScaledQuantizedSse(float* aValues, const short* aLayer, const float aScalar, const int aCount)
+			{
+				const __m128 scalar = _mm_set1_ps(aScalar);
+				int i = 0;
+				for (; i + 8 <= aCount; i += 8)
+				{
+					__m128 low, high;
+					DecodeSse(aLayer + i, low, high);
+					_mm_storeu_ps(aValues + i, _mm_add_ps(_mm_loadu_ps(aValues + i), _mm_mul_ps(low, scalar)));
+					_mm_storeu_ps(aValues + i + 4, _mm_add_ps(_mm_loadu_ps(aValues + i + 4), _mm_mul_ps(high, scalar)));
+				}
+				AddScaledQuantizedScalar(aValues + i, aLayer + i, aScalar, aCount - i);
+			}
+			void MultiplyScaledQuantizedSse(float* aValues, const short* aLayer, const float aScalar, const int aCount)
+			{
+				const __m128 scalar = _mm_set1_ps(aScalar);
+				int i = 0;
+				for (; i + 8 <= aCount; i += 8)
+				{
+					__m128 low, high;
+					DecodeSse(aLayer + i, low, high);
+					_mm_storeu_ps(aValues + i, _mm_mul_ps(_mm_loadu_ps(aValues + i), _mm_mul_ps(low, scalar)));
+					_mm_storeu_ps(aValues + i + 4, _mm_mul_ps(_mm_loadu_ps(aValues + i + 4), _mm_mul_ps(high, scalar)));
+				}
+				MultiplyScaledQuantizedScalar(aValues + i, aLayer + i, aScalar, aCount - i);
+			}
+			void QuantizeSse(const float* aValues, const float aInvStep, short* aOut, const int aCount)
+			{
+				// Converting rounds to nearest like the scalar tail, packing saturates to the int16 range.
+				const __m128 invStep = _mm_set1_ps(aInvStep);
+				const __m128 highest = _mm_set1_ps(32767.0f);
+				const __m128 lowest = _mm_set1_ps(-32768.0f);
+				int i = 0;
+				for (; i + 8 <= aCount; i += 8)
+				{
+					__m128 low = _mm_min_ps(highest, _mm_max_ps(lowest, _mm_mul_ps(_mm_loadu_ps(aValues + i), invStep)));
+					__m128 high = _mm_min_ps(highest, _mm_max_ps(lowest, _mm_mul_ps(_mm_loadu_ps(aValues + i + 4), invStep)));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(aOut + i), _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high)));
+				}
+				QuantizeScalar(aValues + i, aInvStep, aOut + i, aCount - i);
+			}
+
+#pragma endregion
+
+#pragma region AVX
+
+			HEATMAP_TARGET_AVX float HorizontalMax(__m256 aLanes)
+			{
+				__m128 lanes = _mm_max_ps(_mm256_castps256_ps128(aLanes), _mm256_extractf128_ps(aLanes, 1));
+				return HorizontalMax(lanes);
+			}
+
+			// First aCount lanes set, for finishing a row in one masked step. Sparse layers hand over rows in pieces
+			// of up to a tile, a scalar tail on each of them cost more than the vector part.
+			HEATMAP_TARGET_AVX inline __m256i TailMaskAvx(const int aCount)
+			{
+				alignas(32) static const int lanes[16] = { -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0 };
+				return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes + 8 - aCount));
+			}
+			HEATMAP_TARGET_AVX void AddScaledAvx(float* aValues, const float* aLayer, const float aScalar, const int aCount)
+			{
+				const __m256 scalar = _mm256_set1_ps(aScalar);
+				int i = 0;
+				for (; i + 8 <= aCount; i += 8)
+				{
+					__m256 product = _mm256_mul_ps(_mm256_loadu_ps(aLayer + i), scalar);
+					_mm256_storeu_ps(aValues + i, _mm256_add_ps(_mm256_loadu_ps(aValues + i), product));
+				}
+				if (i < aCount)
+				{
+					const __m256i mask = TailMaskAvx(aCount - i);
+					__m256 product = _mm256_mul_ps(_mm256_maskload_ps(aLayer + i, mask), scalar);
+					_mm256_maskstore_ps(aValues + i, mask, _mm256_add_ps(_mm256_maskload_ps(aValues + i, mask), product));
+				}
+			}
+			HEATMAP_TARGET_AVX void MultiplyScaledAvx(float* aValues, const float* aLayer, const float aScalar, const int aCount)
+			{
+				const __m256 scalar = _mm256_set1_ps(aScalar);
+				int i = 0;
+				for (; i + 8 <= aCount; i += 8)
+				{
+					__m256 product = _mm256_mul_ps(_mm256_loadu_ps(aLayer + i), scalar);
+					_mm256_storeu_ps(aValues + i, _mm256_mul_ps(_mm256_loadu_ps(aValues + i), product));
+				}
+				if (i < aCount)
+				{
+					const __m256i mask = TailMaskAvx(aCount - i);
+					__m256 product = _mm256_mul_ps(_mm256_maskload_ps(aLayer + i, mask), scalar);
+					_mm256_maskstore_ps(aValues + i, mask, _mm256_mul_ps(_mm256_maskload_ps(aValues + i, mask), product));
+				}
+			}
+			HEATMAP_TARGET_AVX void AddScaledBlockAvx(float* aValues, const int aValuesStride, const float* aLayer, const int aLayerStride, const float aScalar, const int aCount, const int aRows)
+			{
+				for (int row = 0; row < aRows; row++)
+				{
+					AddScaledAvx(aValues + row * aValuesStride, aLayer + row * aLayerStride, aScalar, aCount);
+				}
+			}
+			HEATMAP_TARGET_AVX void MultiplyScaledBlockAvx(float* aValues, const int aValuesStride, const float* aLayer, const int aLayerStride, const float aScalar, const int aCount, const int aRows)
+			{
+				for (int row = 0; row < aRows; row++)
+				{
+					MultiplyScaledAvx(aValues + row * aValuesStride, aLayer + row * aLayerStride, aScalar, aCount);
+				}
+			}
+			HEATMAP_TARGET_AVX void ScaleAvx(float* aValues, const float aScalar, const int aCount)
+			{
+				const __m256 scalar = _mm256_set1_ps(aScalar);
+				int i = 0;
+				for (; i + 8 <= aCount; i += 8)
+				{
+					_mm256_storeu_ps(aValues + i, _mm256_mul_ps(_mm256_loadu_ps(aValues + i), scalar));
+				}
+				ScaleScalar(aValues + i, aScalar, aCount - i);
+			}
+			HEATMAP_TARGET_AVX float MaxAvx(const float* aValues, const int aCount)
+			{
+				__m256 best = _mm256_set1_ps(NegativeInfinity);
+				int i = 0;
+				for (; i + 8 <= aCount; i += 8)
+				{
+					best = _mm256_max_ps(best, _mm256_loadu_ps(aValues + i));
+				}
+				return MaxScalar(aValues + i, aCount - i, HorizontalMax(best));
+			}
+			HEATMAP_TARGET_AVX float MaxNonZeroProductAvx(const float* aValues, const float* aWeights, const int aCount)
+			{
+				const __m256 zero = _mm256_setzero_ps();
+				const __m256 negInf = _mm256_set1_ps(NegativeInfinity);
+				__m256 best = negInf;
+				int i = 0;
+				for (; i + 8 <= aCount; i += 8)
+				{
+					__m256 product = _mm256_mul_ps(_mm256_loadu_ps(aValues + i), _mm256_loadu_ps(aWeights + i));
+					__m256 nonZero = _mm256_cmp_ps(product, zero, _CMP_NEQ_UQ);
+					best = _mm256_max_ps(best, _mm256_blendv_ps(negInf, product, nonZero));
+				}
+				return MaxNonZeroProductScalar(aValues + i, aWeights + i, aCount - i, HorizontalMax(best));
+			}
+			HEATMAP_TARGET_AVX void PositionsToCellsAvx(const float* aX, const float* aZ, const int aCount, const float aMinX, const float aMinZ, const float aCellSize, int* aOutX, int* aOutY)
+			{
+				const __m256 minX = _mm256_set1_ps(aMinX);
+				const __m256 minZ = _mm256_set1_ps(aMinZ);
+				const __m256 cellSize = _mm256_set1_ps(aCellSize);
+				int i = 0;
+				for (; i + 8 <= aCount; i += 8)
+				{
+					__m256i cellX = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(aX + i), minX), cellSize));
+					__m256i cellY = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(aZ + i), minZ), cellSize));
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(aOutX + i), cellX);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(aOutY + i), cellY);
+				}
+				PositionsToCellsScalar(aX + i, aZ + i, aCount - i, aMinX, aMinZ, aCellSize, aOutX + i, aOutY + i);
+			}
+
+			HEATMAP_TARGET_AVX inline __m256 DecodeAvx(const short* aLayer)
+			{
+				// 256-bit integer unpacking needs AVX2, the halves are widened in SSE registers instead.
+				__m128 low, high;
+				DecodeSse(aLayer, low, high);
+				return _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+			}
+			HEATMAP_TARGET_AVX void AddScaledQuantizedAvx(float* aValues, const short* aLayer, const float aScalar, const int aCount)
+			{
+				const __m256 scalar = _mm256_set1_ps(aScalar);
+				int i = 0;
+				for (; i + 8 <= aCount; i += 8)
+				{
+					__m256 product = _mm256_mul_ps(DecodeAvx(aLayer + i), scalar);
+					_mm256_storeu_ps(aValues + i, _mm256_add_ps(_mm256_loadu_ps(aValues + i), product));
+				}
+				AddScaledQuantizedScalar(aValues + i, aLayer + i, aScalar, aCount - i);
+			}
+			HEATMAP_TARGET_AVX void MultiplyScaledQuantizedAvx(float* aValues, const short* aLayer, const float aScalar, const int aCount)
+			{
+				const __m256 scalar = _mm256_set1_ps(aScalar);
+				int i = 0;
+				for (; i + 8 <= aCount; i += 8)
+				{
+					__m256 product = _mm256_mul_ps(DecodeAvx(aLayer + i), scalar);
+					_mm256_storeu_ps(aValues + i, _mm256_mul_ps(_mm256_loadu_ps(aValues + i), product));
+				}
+				MultiplyScaledQuantizedScalar(aValues + i, aLayer + i, aScalar, aCount - i);
+			}
+
+#pragma endregion
+
+			bool SupportsAvx()
+			{
+#ifdef _MSC_VER
+				int info[4];
+				__cpuid(info, 1);
+				bool osSavesState = (info[2] & (1 << 27)) != 0;
+				bool hasAvx = (info[2] & (1 << 28)) != 0;
+				return osSavesState && hasAvx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+				return __builtin_cpu_supports("avx");
+#endif
+			}
+#endif
+
+			Kernels SelectKernels()
+			{
+#ifdef HEATMAP_X86
+				if (SupportsAvx())
+				{
+					return {
+						AddScaledAvx, MultiplyScaledAvx, AddScaledBlockAvx, MultiplyScaledBlockAvx, ScaleAvx, MaxAvx, MaxNonZeroProductAvx, PositionsToCellsAvx,
+						AddScaledQuantizedAvx, MultiplyScaledQuantizedAvx, QuantizeSse };
+				}
+				return {
+					AddScaledSse, MultiplyScaledSse, AddScaledBlockSse, MultiplyScaledBlockSse, ScaleSse, MaxSse, MaxNonZeroProductSse, PositionsToCellsSse,
+					AddScaledQuantizedSse, MultiplyScaledQuantizedSse, QuantizeSse };
+#else
+				return {
+					AddScaledScalar, MultiplyScaledScalar, AddScaledBlockScalar, MultiplyScaledBlockScalar, ScaleScalar,
+					[](const float* aValues, const int aCount) { return MaxScalar(aValues, aCount); },
+					[](const float* aValues, const float* aWeights, const int aCount) { return MaxNonZeroProductScalar(aValues, aWeights, aCount); },
+					PositionsToCellsScalar, AddScaledQuantizedScalar, MultiplyScaledQuantizedScalar, QuantizeScalar };
+#endif
+			}
+
+			const Kernels& GetKernels()
+			{
+				static const Kernels kernels = SelectKernels();
+				return kernels;
+			}
+		}
+
+		void AddScaled(float* aValues, const float* aLayer, const float aScalar, const int aCount)
+		{
+			GetKernels().addScaled(aValues, aLayer, aScalar, aCount);
+		}
+		void MultiplyScaled(float* aValues, const float* aLayer, const float aScalar, const int aCount)
+		{
+			GetKernels().multiplyScaled(aValues, aLayer, aScalar, aCount);
+		}
+		void AddScaledBlock(float* aValues, const int aValuesStride, const float* aLayer, const int aLayerStride, const float aScalar, const int aCount, const int aRows)
+		{
+			GetKernels().addScaledBlock(aValues, aValuesStride, aLayer, aLayerStride, aScalar, aCount, aRows);
+		}
+		void MultiplyScaledBlock(float* aValues, const int aValuesStride, const float* aLayer, const int aLayerStride, const float aScalar, const int aCount, const int aRows)
+		{
+			GetKernels().multiplyScaledBlock(aValues, aValuesStride, aLayer, aLayerStride, aScalar, aCount, aRows);
+		}
+		void Scale(float* aValues, const float aScalar, const int aCount)
+		{
+			GetKernels().scale(aValues, aScalar, aCount);
+		}
+		float Max(const float* aValues, const int aCount)
+		{
+			return GetKernels().max(aValues, aCount);
+		}
+		float MaxNonZeroProduct(const float* aValues, const float* aWeights, const int aCount)
+		{
+			return GetKernels().maxNonZeroProduct(aValues, aWeights, aCount);
+		}
+		void PositionsToCells(const float* aX, const float* aZ, const int aCount, const float aMinX, const float aMinZ, const float aCellSize, int* aOutX, int* aOutY)
+		{
+			GetKernels().positionsToCells(aX, aZ, aCount, aMinX, aMinZ, aCellSize, aOutX, aOutY);
+		}
+		void AddScaledQuantized(float* aValues, const short* aLayer, const float aScalar, const int aCount)
+		{
+			GetKernels().addScaledQuantized(aValues, aLayer, aScalar, aCount);
+		}
+		void MultiplyScaledQuantized(float* aValues, const short* aLayer, const float aScalar, const int aCount)
+		{
+			GetKernels().multiplyScaledQuantized(aValues, aLayer, aScalar, aCount);
+		}
+		void Quantize(const float* aValues, const float aInvStep, short* aOut, const int aCount)
+		{
+			GetKernels().quantize(aValues, aInvStep, aOut, aCount);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+namespace AI
+{
+	namespace simd
+	{
+		// Row kernels for the workmap pipeline, the widest instruction set the CPU supports is picked on first use.
+		void AddScaled(float* aValues, const float* aLayer, const float aScalar, const int aCount);
+		void MultiplyScaled(float* aValues, const float* aLayer, const float aScalar, const int aCount);
+		void Scale(float* aValues, const float aScalar, const int aCount);
+		// Same over aRows rows, the rows of each side stride floats apart. One call per tile of a sparse layer
+		// rather than one per row and tile.
+		void AddScaledBlock(float* aValues, const int aValuesStride, const float* aLayer, const int aLayerStride, const float aScalar, const int aCount, const int aRows);
+		void MultiplyScaledBlock(float* aValues, const int aValuesStride, const float* aLayer, const int aLayerStride, const float aScalar, const int aCount, const int aRows);
+		// Largest value in the range, -infinity for an empty range.
+		float Max(const float* aValues, const int aCount);
+
+		// Largest non-zero aValues[i] * aWeights[i], or -infinity when every product is zero.
+		float MaxNonZeroProduct(const float* aValues, const float* aWeights, const int aCount);
+
+		// Same for quantized layers, aScalar has the step size folded in.
+		void AddScaledQuantized(float* aValues, const short* aLayer, const float aScalar, const int aCount);
+		void MultiplyScaledQuantized(float* aValues, const short* aLayer, const float aScalar, const int aCount);
+		// Rounds aValues[i] * aInvStep to the nearest step, saturated to the int16 range.
+		void Quantize(const float* aValues, const float aInvStep, short* aOut, const int aCount);
+
+		// Grid cell of every position, truncated like Heatmap::GetCoordinate so both always agree.
+		void PositionsToCells(const float* aX, const float* aZ, const int aCount, const float aMinX, const float aMinZ, const float aCellSize, int* aOutX, int* aOutY);
+	}
+}
\ No newline at end of file
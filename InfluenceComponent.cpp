@@ -10,7 +10,7 @@ namespace AI
 	InfluenceComponent::InfluenceComponent(KE::GameObject& aGo) : KE::Component(aGo),
 		myPosition(aGo.myTransform.GetPositionRef())
 	{
-	
+		myImprintIndex.fill(-1);
 	}
 
 	InfluenceComponent::~InfluenceComponent() 
@@ -29,6 +29,18 @@ namespace AI
 
 		myTeam = data.team;
 		myImprints = data.influenceTypes;
+		isStatic = data.isStatic;
+		myHeatmapManager = data.heatmapManager;
+
+		// The first imprint of a type wins, the same one the old linear search found.
+		myImprintIndex.fill(-1);
+		for (int i = static_cast<int>(myImprints.size()) - 1; i >= 0; i--)
+		{
+			if (myImprints[i].type == HeatType::COUNT) continue;
+
+			myImprintIndex[static_cast<int>(myImprints[i].type)] = i;
+		}
+
 		data.heatmapManager->Register(*this);
 	}
 
@@ -40,13 +52,10 @@ namespace AI
 
 	const InfluenceData* InfluenceComponent::GetTemplate(HeatType aType) const
 	{
-		for (auto& data : myImprints)
-		{
-			if(data.type != aType) continue;
+		if (aType == HeatType::COUNT) return nullptr;
 
-			return &data;
-		}
-		return nullptr;
+		int index = myImprintIndex[static_cast<int>(aType)];
+		return index >= 0 ? &myImprints[index] : nullptr;
 	}
 
 	const int InfluenceComponent::GetID() const
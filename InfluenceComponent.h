@@ -2,6 +2,7 @@
 #include <Engine/Source/ComponentSystem/Components/Component.h>
 #include <Engine/Source/AI/HeatmapSystem/InterestCurves.h>
 #include <Engine/Source/AI/HeatmapSystem/HeatmapCommonData.h>
+#include <Engine/Source/AI/HeatmapSystem/UserRegistry.h>
 
 
 
@@ -14,11 +15,13 @@ namespace AI
 		Team team = Team::COUNT;
 		std::vector<InfluenceData> influenceTypes;
 		HeatmapManager* heatmapManager = nullptr;
+		bool isStatic = false; // Never moves once registered, baked once instead of repainted every tick.
 	};
 	
 	class InfluenceComponent : public KE::Component
 	{
 		friend class HeatmapManager;
+		friend class UserRegistry;
 		friend class LevelImporter;
 
 	public:
@@ -30,17 +33,19 @@ namespace AI
 
 		const InfluenceData* GetTemplate(HeatType aType) const;
 		inline Team GetTeam() const { return myTeam; }
+		inline bool IsStatic() const { return isStatic; }
+		inline const UserHandle& GetHandle() const { return myHandle; }
 		const int GetID() const;
 
-
-		Vector2i location;
-		Vector2i futureLocation;
 		const Vector3f& myPosition;
 		const Vector3f* myVelocity = nullptr;
 	private:
 		std::vector<InfluenceData> myImprints;
+		std::array<int, static_cast<int>(HeatType::COUNT)> myImprintIndex; // Index into myImprints per HeatType, -1 if none.
+		UserHandle myHandle; // Cells and the packed copy of this user live in the manager's registry.
 		Team myTeam = Team::COUNT;
 		HeatmapManager* myHeatmapManager = nullptr;
 		bool isDynamic = false;
+		bool isStatic = false;
 	};
 }
\ No newline at end of file
@@ -65,3 +65,13 @@ public:
 	}
 };
 
+// Compile-time wrappers around FalloffCurve so kernels can be templated on the curve and inline it.
+namespace FalloffPolicy
+{
+	struct Linear { static inline float Evaluate(float aDistance, float aRadius) { return FalloffCurve::Linear(aDistance, aRadius); } };
+	struct EaseInQuint { static inline float Evaluate(float aDistance, float aRadius) { return FalloffCurve::EaseInQuint(aDistance, aRadius); } };
+	struct InverseLinear { static inline float Evaluate(float aDistance, float aRadius) { return FalloffCurve::InverseLinear(aDistance, aRadius); } };
+	struct EaseInCirc { static inline float Evaluate(float aDistance, float aRadius) { return FalloffCurve::EaseInCirc(aDistance, aRadius); } };
+	struct Read { static inline float Evaluate(float aDistance, float aRadius) { return FalloffCurve::Read(aDistance, aRadius); } };
+	struct Attractor { static inline float Evaluate(float aDistance, float aRadius) { return FalloffCurve::Attractor(aDistance, aRadius); } };
+}
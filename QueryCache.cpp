@@ -0,0 +1,59 @@
+#include "stdafx.h"
+#include "QueryCache.h"
+
+namespace AI
+{
+	bool QueryCache::Find(const QueryKey& aKey, const std::vector<QueryOperation>& aRecipe, const std::vector<unsigned long long>& aVersions, int& aOutCell)
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+
+		auto it = myEntries.find(aKey);
+		if (it == myEntries.end() || it->second->recipe != aRecipe || it->second->versions != aVersions)
+		{
+			myMisses++;
+			return false;
+		}
+
+		myHits++;
+		myOrder.splice(myOrder.begin(), myOrder, it->second);
+		aOutCell = it->second->cell;
+		return true;
+	}
+	void QueryCache::Store(const QueryKey& aKey, const std::vector<QueryOperation>& aRecipe, const std::vector<unsigned long long>& aVersions, const int aCell)
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+
+		// Stale entries are overwritten by their own key, as is a different recipe that happens to share the hash.
+		auto it = myEntries.find(aKey);
+		if (it != myEntries.end())
+		{
+			myOrder.splice(myOrder.begin(), myOrder, it->second);
+		}
+		else
+		{
+			myOrder.emplace_front();
+			myOrder.front().key = aKey;
+			myEntries[aKey] = myOrder.begin();
+		}
+
+		Entry& entry = myOrder.front();
+		entry.recipe = aRecipe;
+		entry.versions = aVersions;
+		entry.cell = aCell;
+
+		while (myOrder.size() > myCapacity)
+		{
+			myEntries.erase(myOrder.back().key);
+			myOrder.pop_back();
+		}
+	}
+	void QueryCache::Clear()
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+
+		myEntries.clear();
+		myOrder.clear();
+		myHits = 0;
+		myMisses = 0;
+	}
+}
\ No newline at end of file
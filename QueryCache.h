@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace AI
+{
+	// One step of a query recipe. The recipe hash in QueryKey only finds the entry, a hit also needs every step equal.
+	struct QueryOperation
+	{
+		enum class Kind : unsigned char { Add, Normalize, Exclude };
+
+		Kind kind = Kind::Add;
+		int layer = 0; // Layer index of an Add, HeatType of an Exclude.
+		float scalar = 0.0f; // Weight of an Add, max value of an Exclude.
+
+		// Exclude only, the imprint's shape and the cells its user is painted at.
+		int falloff = 0;
+		int radius = 0;
+		int cell = 0;
+		int futureCell = 0;
+
+		inline bool operator==(const QueryOperation& aOther) const
+		{
+			return kind == aOther.kind && layer == aOther.layer && scalar == aOther.scalar && falloff == aOther.falloff &&
+				radius == aOther.radius && cell == aOther.cell && futureCell == aOther.futureCell;
+		}
+	};
+
+	// Identifies a query recipe evaluated at one cell. Agents standing in the same cell and asking the same
+	// question produce the same key.
+	struct QueryKey
+	{
+		int originIndex = 0;
+		int radius = 0;
+		size_t recipe = 0;
+
+		inline bool operator==(const QueryKey& aOther) const
+		{
+			return originIndex == aOther.originIndex && radius == aOther.radius && recipe == aOther.recipe;
+		}
+	};
+
+	struct QueryKeyHash
+	{
+		inline size_t operator()(const QueryKey& aKey) const
+		{
+			size_t hash = std::hash<int>()(aKey.originIndex);
+			hash ^= std::hash<int>()(aKey.radius) + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+			hash ^= aKey.recipe + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+			return hash;
+		}
+	};
+
+	// Shared results of workmap queries, validated against the versions of the layer tiles the query read.
+	// A stored result is only handed out while every one of those tiles is unchanged. Past the capacity the
+	// least recently used entry makes room.
+	class QueryCache
+	{
+	public:
+		// aOutCell is the world cell index of the result, or -1 when the query found nothing.
+		bool Find(const QueryKey& aKey, const std::vector<QueryOperation>& aRecipe, const std::vector<unsigned long long>& aVersions, int& aOutCell);
+		void Store(const QueryKey& aKey, const std::vector<QueryOperation>& aRecipe, const std::vector<unsigned long long>& aVersions, const int aCell);
+		void Clear();
+
+		inline void SetCapacity(const size_t aCapacity) { myCapacity = aCapacity; }
+		int GetHits() const { return myHits.load(); }
+		int GetMisses() const { return myMisses.load(); }
+
+	private:
+		struct Entry
+		{
+			QueryKey key;
+			std::vector<QueryOperation> recipe;
+			std::vector<unsigned long long> versions;
+			int cell = -1;
+		};
+
+		std::mutex myMutex;
+		std::list<Entry> myOrder; // Most recently used first.
+		std::unordered_map<QueryKey, std::list<Entry>::iterator, QueryKeyHash> myEntries;
+		size_t myCapacity = 4096;
+		std::atomic<int> myHits = 0;
+		std::atomic<int> myMisses = 0;
+	};
+}
\ No newline at end of file
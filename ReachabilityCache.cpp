@@ -0,0 +1,148 @@
+#include "stdafx.h"
+#include "ReachabilityCache.h"
+
+namespace AI
+{
+	void ReachabilityCache::Init(const std::vector<bool>* aValidCells, const Vector2i& aGridSize)
+	{
+		Clear();
+		myValidCells = aValidCells;
+		myGridSize = aGridSize;
+	}
+	void ReachabilityCache::Clear()
+	{
+		for (Shard& shard : myShards)
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			shard.order.clear();
+			shard.entries.clear();
+			shard.bytes = 0;
+		}
+
+		myHits = 0;
+		myMisses = 0;
+	}
+	void ReachabilityCache::SetMemoryBudget(const size_t aBytes)
+	{
+		myShardBudget = aBytes / ShardCount;
+
+		for (Shard& shard : myShards)
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			Evict(shard);
+		}
+	}
+	size_t ReachabilityCache::GetBytes()
+	{
+		size_t bytes = 0;
+		for (Shard& shard : myShards)
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			bytes += shard.bytes;
+		}
+		return bytes;
+	}
+
+	std::shared_ptr<const ReachMask> ReachabilityCache::Get(const Vector2i& aOrigin, const int aRadius)
+	{
+		Key key = (static_cast<Key>(aOrigin.y * myGridSize.x + aOrigin.x) << 8) | static_cast<Key>(aRadius);
+		Shard& shard = myShards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+
+			auto it = shard.entries.find(key);
+			if (it != shard.entries.end())
+			{
+				shard.order.splice(shard.order.begin(), shard.order, it->second);
+				myHits.fetch_add(1, std::memory_order_relaxed);
+				return it->second->second;
+			}
+		}
+
+		// Built outside the lock, two threads missing on the same key both build it and the first one is kept.
+		myMisses.fetch_add(1, std::memory_order_relaxed);
+		std::shared_ptr<const ReachMask> mask = Build(aOrigin, aRadius);
+		const size_t bytes = mask->GetBytes();
+
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		auto it = shard.entries.find(key);
+		if (it != shard.entries.end()) return it->second->second;
+		if (bytes > myShardBudget) return mask;
+
+		shard.order.emplace_front(key, mask);
+		shard.entries[key] = shard.order.begin();
+		shard.bytes += bytes;
+		Evict(shard);
+
+		return mask;
+	}
+
+	void ReachabilityCache::Evict(Shard& aShard)
+	{
+		while (aShard.bytes > myShardBudget)
+		{
+			aShard.bytes -= aShard.order.back().second->GetBytes();
+			aShard.entries.erase(aShard.order.back().first);
+			aShard.order.pop_back();
+		}
+	}
+
+	std::shared_ptr<const ReachMask> ReachabilityCache::Build(const Vector2i& aOrigin, const int aRadius) const
+	{
+		std::shared_ptr<ReachMask> mask = std::make_shared<ReachMask>();
+		const int dimensions = aRadius * 2 + 1;
+		mask->radius = aRadius;
+		mask->steps.assign(dimensions * dimensions, 0);
+		mask->rowBegin.assign(dimensions, static_cast<short>(dimensions));
+		mask->rowEnd.assign(dimensions, -1);
+
+		// Same walk as the flood fill: four neighbours, clipped to the grid and the window, the origin always counts.
+		Vector2i boundsMin = { std::max(0, aOrigin.x - aRadius), std::max(0, aOrigin.y - aRadius) };
+		Vector2i boundsMax = { std::min(myGridSize.x - 1, aOrigin.x + aRadius), std::min(myGridSize.y - 1, aOrigin.y + aRadius) };
+		std::array<Vector2i, 4> directions = { Vector2i(0, 1), Vector2i(-1, 0), Vector2i(0, -1), Vector2i(1, 0) };
+
+		thread_local std::vector<FloodFillNode> queue;
+		queue.clear();
+
+		Vector2i center = { aRadius, aRadius };
+		mask->steps[aRadius * dimensions + aRadius] = 1;
+		queue.push_back({ aOrigin, center, 1 });
+
+		for (size_t head = 0; head < queue.size(); head++)
+		{
+			const FloodFillNode node = queue[head];
+
+			for (const auto& direction : directions)
+			{
+				Vector2i nextCoord = node.coord + direction;
+				Vector2i nextTemplateCoord = node.templateCoord + direction;
+
+				if (nextCoord.x < boundsMin.x || nextCoord.x > boundsMax.x ||
+					nextCoord.y < boundsMin.y || nextCoord.y > boundsMax.y) {
+					continue;
+				}
+
+				int templateIndex = nextTemplateCoord.y * dimensions + nextTemplateCoord.x;
+				if (mask->steps[templateIndex] != 0 || !(*myValidCells)[nextCoord.y * myGridSize.x + nextCoord.x]) continue;
+
+				mask->steps[templateIndex] = static_cast<unsigned short>(node.distance + 1);
+				queue.push_back({ nextCoord, nextTemplateCoord, node.distance + 1 });
+			}
+		}
+
+		for (int row = 0; row < dimensions; row++)
+		{
+			for (int col = 0; col < dimensions; col++)
+			{
+				if (mask->steps[row * dimensions + col] == 0) continue;
+
+				mask->rowBegin[row] = std::min(mask->rowBegin[row], static_cast<short>(col));
+				mask->rowEnd[row] = static_cast<short>(col);
+			}
+		}
+
+		return mask;
+	}
+}
\ No newline at end of file
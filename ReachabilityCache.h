@@ -0,0 +1,76 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <Engine/Source/AI/HeatmapSystem/HeatmapCommonData.h>
+
+namespace AI
+{
+	// Cells a flood fill from one origin reaches inside a square window, and how many steps it takes to get there.
+	// Steps rather than a bit per cell since ring falloff is applied by the walked distance, which detours around
+	// obstacles make longer than the template's. Cells are in template order, 0 is unreachable and the origin is 1.
+	// Rows with nothing reachable have rowBegin > rowEnd.
+	struct ReachMask
+	{
+		int radius = 0;
+		std::vector<unsigned short> steps;
+		std::vector<short> rowBegin;
+		std::vector<short> rowEnd;
+
+		inline size_t GetBytes() const
+		{
+			return sizeof(ReachMask) + steps.size() * sizeof(unsigned short) + (rowBegin.size() + rowEnd.size()) * sizeof(short);
+		}
+	};
+
+	// Reach masks per origin cell and radius, built on first use and evicted least recently used once they take more
+	// than the memory budget. Levels don't change while they run, so the only invalidation is Clear when the valid
+	// cells are rebuilt. Thread-safe, entries are spread over shards so parallel repaints rarely wait on each other.
+	class ReachabilityCache
+	{
+	public:
+		// Beyond this radius step counts could overflow, those fills are never cached.
+		static constexpr int MaxRadius = 127;
+
+		void Init(const std::vector<bool>* aValidCells, const Vector2i& aGridSize);
+		void Clear();
+		// Total bytes of masks kept, split evenly over the shards. Masks larger than a shard's share are not kept.
+		void SetMemoryBudget(const size_t aBytes);
+		size_t GetBytes();
+
+		// Origin has to be inside the grid.
+		std::shared_ptr<const ReachMask> Get(const Vector2i& aOrigin, const int aRadius);
+
+		inline int GetHits() const { return myHits.load(std::memory_order_relaxed); }
+		inline int GetMisses() const { return myMisses.load(std::memory_order_relaxed); }
+
+	private:
+		static constexpr int ShardCount = 16;
+
+		using Key = unsigned long long;
+		using Entry = std::pair<Key, std::shared_ptr<const ReachMask>>;
+
+		struct Shard
+		{
+			std::mutex mutex;
+			std::list<Entry> order; // Most recently used first.
+			std::unordered_map<Key, std::list<Entry>::iterator> entries;
+			size_t bytes = 0;
+		};
+
+		std::shared_ptr<const ReachMask> Build(const Vector2i& aOrigin, const int aRadius) const;
+		// Drops the least recently used masks until the shard fits its budget, shard mutex held.
+		void Evict(Shard& aShard);
+
+		std::array<Shard, ShardCount> myShards;
+		size_t myShardBudget = (64u << 20) / ShardCount;
+		const std::vector<bool>* myValidCells = nullptr;
+		Vector2i myGridSize;
+		std::atomic<int> myHits = 0;
+		std::atomic<int> myMisses = 0;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "stdafx.h"
+#include "RegistrationQueue.h"
+
+namespace AI
+{
+	RegistrationQueue::RegistrationQueue(const size_t aCapacity)
+	{
+		size_t capacity = 2;
+		while (capacity < aCapacity) capacity <<= 1;
+
+		myCells = std::make_unique<Cell[]>(capacity);
+		myMask = capacity - 1;
+
+		for (size_t i = 0; i < capacity; i++)
+		{
+			myCells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	void RegistrationQueue::Push(const Registration& aRegistration)
+	{
+		if (!myOverflowing.load(std::memory_order_acquire) && TryPush(aRegistration)) return;
+
+		std::lock_guard<std::mutex> lock(myOverflowMutex);
+		myOverflow.push_back(aRegistration);
+		myOverflowing.store(true, std::memory_order_release);
+	}
+
+	void RegistrationQueue::Drain(std::vector<Registration>& aOut)
+	{
+		Registration registration;
+		while (TryPop(registration))
+		{
+			aOut.push_back(registration);
+		}
+
+		// Everything in the overflow was pushed after the ring filled up, so it goes after the ring.
+		if (myOverflowing.load(std::memory_order_acquire))
+		{
+			std::lock_guard<std::mutex> lock(myOverflowMutex);
+			aOut.insert(aOut.end(), myOverflow.begin(), myOverflow.end());
+			myOverflow.clear();
+			myOverflowing.store(false, std::memory_order_release);
+		}
+	}
+
+	bool RegistrationQueue::TryPush(const Registration& aRegistration)
+	{
+		// Bounded queue by Dmitry Vyukov. A cell's sequence tells producers and the consumer whose turn it is.
+		size_t position = myEnqueuePos.load(std::memory_order_relaxed);
+		Cell* cell = nullptr;
+
+		for (;;)
+		{
+			cell = &myCells[position & myMask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+			if (difference == 0)
+			{
+				if (myEnqueuePos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+			}
+			else if (difference < 0)
+			{
+				return false;
+			}
+			else
+			{
+				position = myEnqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->registration = aRegistration;
+		cell->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool RegistrationQueue::TryPop(Registration& aOut)
+	{
+		size_t position = myDequeuePos.load(std::memory_order_relaxed);
+		Cell& cell = myCells[position & myMask];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+		if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1) < 0) return false;
+
+		myDequeuePos.store(position + 1, std::memory_order_relaxed);
+		aOut = cell.registration;
+		cell.sequence.store(position + myMask + 1, std::memory_order_release);
+		return true;
+	}
+}
\ No newline at end of file
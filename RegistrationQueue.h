@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace AI
+{
+	class InfluenceComponent;
+
+	struct Registration
+	{
+		InfluenceComponent* user = nullptr;
+		bool add = true;
+	};
+
+	// Multi-producer, single-consumer queue of Register/DeRegister calls. Any thread can push without taking
+	// a lock, only the game thread drains. Pushes that find the ring full go to a locked overflow list, and keep
+	// going there until the next drain, so one thread's calls always come out in the order they went in.
+	class RegistrationQueue
+	{
+	public:
+		// Capacity is rounded up to a power of two.
+		explicit RegistrationQueue(const size_t aCapacity = 1024);
+		RegistrationQueue(const RegistrationQueue&) = delete;
+		RegistrationQueue& operator=(const RegistrationQueue&) = delete;
+
+		void Push(const Registration& aRegistration);
+		// Appends everything queued so far to aOut. Only ever called from one thread.
+		void Drain(std::vector<Registration>& aOut);
+
+	private:
+		bool TryPush(const Registration& aRegistration);
+		bool TryPop(Registration& aOut);
+
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			Registration registration;
+		};
+
+		std::unique_ptr<Cell[]> myCells;
+		size_t myMask = 0;
+		alignas(64) std::atomic<size_t> myEnqueuePos = 0;
+		alignas(64) std::atomic<size_t> myDequeuePos = 0;
+
+		std::mutex myOverflowMutex;
+		std::vector<Registration> myOverflow;
+		std::atomic<bool> myOverflowing = false;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "stdafx.h"
+#include "SeparableKernel.h"
+#include <cmath>
+#include <numeric>
+
+namespace AI
+{
+	std::shared_ptr<const SeparableKernel> SeparableKernel::Create(const HeatTemplate& aTemplate, const float aTolerance)
+	{
+		const int size = aTemplate.dimensions;
+		const int radius = size / 2;
+
+		// What an unobstructed flood fill writes: the origin as is, every other cell scaled by the falloff of its ring.
+		std::vector<double> matrix(size * size);
+		double energy = 0.0;
+		for (int row = 0; row < size; row++)
+		{
+			for (int col = 0; col < size; col++)
+			{
+				int distance = std::abs(row - radius) + std::abs(col - radius);
+				double value = aTemplate.values[row * size + col];
+				if (distance > 0) value *= aTemplate.ringFalloff[distance];
+
+				matrix[row * size + col] = value;
+				energy += value * value;
+			}
+		}
+
+		// Curves only depend on distance, so the kernel is symmetric and its eigenvectors give the terms.
+		// Cyclic Jacobi, the kernels are small enough that this is instant next to a single repaint.
+		std::vector<double> vectors(size * size, 0.0);
+		for (int i = 0; i < size; i++) vectors[i * size + i] = 1.0;
+
+		for (int sweep = 0; sweep < 64; sweep++)
+		{
+			double offDiagonal = 0.0;
+			for (int p = 0; p < size; p++)
+			{
+				for (int q = p + 1; q < size; q++) offDiagonal += matrix[p * size + q] * matrix[p * size + q];
+			}
+			if (offDiagonal <= energy * 1e-24) break;
+
+			for (int p = 0; p < size; p++)
+			{
+				for (int q = p + 1; q < size; q++)
+				{
+					double apq = matrix[p * size + q];
+					if (apq == 0.0) continue;
+
+					double theta = (matrix[q * size + q] - matrix[p * size + p]) / (2.0 * apq);
+					double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+					double c = 1.0 / std::sqrt(t * t + 1.0);
+					double s = t * c;
+
+					for (int k = 0; k < size; k++)
+					{
+						double akp = matrix[k * size + p];
+						double akq = matrix[k * size + q];
+						matrix[k * size + p] = c * akp - s * akq;
+						matrix[k * size + q] = s * akp + c * akq;
+					}
+					for (int k = 0; k < size; k++)
+					{
+						double apk = matrix[p * size + k];
+						double aqk = matrix[q * size + k];
+						matrix[p * size + k] = c * apk - s * aqk;
+						matrix[q * size + k] = s * apk + c * aqk;
+					}
+					for (int k = 0; k < size; k++)
+					{
+						double vkp = vectors[k * size + p];
+						double vkq = vectors[k * size + q];
+						vectors[k * size + p] = c * vkp - s * vkq;
+						vectors[k * size + q] = s * vkp + c * vkq;
+					}
+				}
+			}
+		}
+
+		// Largest terms first, until the dropped ones are below the tolerance.
+		std::vector<int> order(size);
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](int aLeft, int aRight)
+		{
+			return std::abs(matrix[aLeft * size + aLeft]) > std::abs(matrix[aRight * size + aRight]);
+		});
+
+		std::shared_ptr<SeparableKernel> kernel = std::make_shared<SeparableKernel>();
+		kernel->radius = radius;
+
+		double remaining = energy;
+		double allowed = energy * aTolerance * aTolerance;
+		for (int term : order)
+		{
+			if (remaining <= allowed) break;
+
+			double scale = matrix[term * size + term];
+			remaining -= scale * scale;
+
+			kernel->scales.push_back(static_cast<float>(scale));
+			for (int k = 0; k < size; k++)
+			{
+				kernel->factors.push_back(static_cast<float>(vectors[k * size + term]));
+			}
+		}
+
+		return kernel;
+	}
+}
\ No newline at end of file
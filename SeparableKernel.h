@@ -0,0 +1,22 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <Engine/Source/AI/HeatmapSystem/HeatmapCommonData.h>
+
+namespace AI
+{
+	// An imprint's open-ground footprint written as a short sum of separable terms, so convolving a whole layer
+	// with it costs two 1D passes per term instead of a 2D stamp per user.
+	struct SeparableKernel
+	{
+		int radius = 0;
+		std::vector<float> scales;  // One per term.
+		std::vector<float> factors; // 2 * radius + 1 weights per term, back to back. Used for both rows and columns.
+
+		inline int GetTermCount() const { return static_cast<int>(scales.size()); }
+		inline const float* GetFactor(const int aTerm) const { return factors.data() + aTerm * (2 * radius + 1); }
+
+		// Terms are kept until what is left of the kernel is below aTolerance of it (Frobenius norm).
+		static std::shared_ptr<const SeparableKernel> Create(const HeatTemplate& aTemplate, const float aTolerance);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "stdafx.h"
+#include "TemplateCache.h"
+#include "Engine/Source/AI/HeatmapSystem/InterestCurves.h"
+
+namespace AI
+{
+	void TemplateCache::Init(const int aPrebuiltSize)
+	{
+		Init(aPrebuiltSize, {});
+	}
+	void TemplateCache::Init(const int aPrebuiltSize, const std::vector<std::shared_ptr<const HeatTemplate>>& aBaked)
+	{
+		Clear();
+
+		myPrebuilt.resize(static_cast<int>(FalloffType::COUNT));
+		for (auto& curve : myPrebuilt) curve.resize(aPrebuiltSize);
+
+		for (const auto& heatTemplate : aBaked)
+		{
+			int curve = static_cast<int>(heatTemplate->falloff);
+			int radius = heatTemplate->dimensions / 2;
+			if (curve < static_cast<int>(myPrebuilt.size()) && radius < aPrebuiltSize) myPrebuilt[curve][radius] = heatTemplate;
+		}
+
+		for (int i = 0; i < static_cast<int>(FalloffType::COUNT); i++)
+		{
+			FalloffType curve = static_cast<FalloffType>(i);
+
+			for (int r = 0; r < aPrebuiltSize; r++)
+			{
+				if (!myPrebuilt[i][r]) myPrebuilt[i][r] = Create(curve, r);
+			}
+		}
+	}
+	void TemplateCache::Clear()
+	{
+		std::unique_lock<std::shared_mutex> lock(myMutex);
+
+		myPrebuilt.clear();
+		myTemplates.clear();
+		myInsertOrder.clear();
+	}
+
+	std::shared_ptr<const HeatTemplate> TemplateCache::Get(const FalloffType aCurve, const int aCellRadius)
+	{
+		int curve = static_cast<int>(aCurve);
+		int radius = std::max(0, aCellRadius);
+
+		if (curve < static_cast<int>(myPrebuilt.size()) && radius < static_cast<int>(myPrebuilt[curve].size()))
+		{
+			return myPrebuilt[curve][radius];
+		}
+
+		unsigned long long key = (static_cast<unsigned long long>(curve) << 32) | static_cast<unsigned int>(radius);
+		{
+			std::shared_lock<std::shared_mutex> lock(myMutex);
+
+			auto it = myTemplates.find(key);
+			if (it != myTemplates.end()) return it->second;
+		}
+
+		// Built outside the lock, two threads racing for the same size both build it and the first one wins.
+		std::shared_ptr<const HeatTemplate> heatTemplate = Create(aCurve, radius);
+
+		std::unique_lock<std::shared_mutex> lock(myMutex);
+
+		auto inserted = myTemplates.insert({ key, heatTemplate });
+		if (!inserted.second) return inserted.first->second;
+
+		myInsertOrder.push_back(key);
+		while (myInsertOrder.size() > myCapacity)
+		{
+			myTemplates.erase(myInsertOrder.front());
+			myInsertOrder.pop_front();
+		}
+
+		return heatTemplate;
+	}
+
+	std::shared_ptr<const HeatTemplate> TemplateCache::Create(const FalloffType aCurve, const int aCellRadius)
+	{
+		std::shared_ptr<HeatTemplate> heatTemplate = std::make_shared<HeatTemplate>();
+		heatTemplate->falloff = aCurve;
+
+		DispatchFalloff(aCurve, [&](auto aPolicy) {
+			Build<decltype(aPolicy)>(aCellRadius, *heatTemplate);
+		});
+
+		return heatTemplate;
+	}
+
+	template<typename Curve>
+	void TemplateCache::Build(const int aCellRadius, HeatTemplate& aTemplate)
+	{
+		int dimension = (aCellRadius * 2);
+		dimension = dimension % 2 != 0 ? dimension : dimension + 1;
+
+		aTemplate.dimensions = dimension;
+		aTemplate.values.resize(dimension * dimension);
+		aTemplate.centerCell = { dimension / 2, dimension / 2 };
+
+		int index = 0;
+
+		// Distance and radius are both in cells, so a template looks the same at every cell size.
+		for (int row = 0; row < dimension; row++)
+		{
+			for (int col = 0; col < dimension; col++)
+			{
+				int coordDistance = (Vector2i(col, row) - aTemplate.centerCell).LengthSqr();
+				float distance = sqrt(static_cast<float>(coordDistance));
+				float interest = Curve::Evaluate(distance, static_cast<float>(aCellRadius));
+
+				aTemplate.values[index] = interest;
+				index++;
+			}
+		}
+
+		// The flood fill scales each BFS ring by the curve, with the ring count as radius.
+		int radius = dimension / 2;
+		int maxIterations = radius + 1;
+		aTemplate.ringFalloff.resize(dimension + 1);
+
+		for (int distance = 0; distance < static_cast<int>(aTemplate.ringFalloff.size()); distance++)
+		{
+			aTemplate.ringFalloff[distance] = Curve::Evaluate(static_cast<float>(distance), static_cast<float>(maxIterations));
+		}
+	}
+}
\ No newline at end of file
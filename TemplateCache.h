@@ -0,0 +1,40 @@
+#pragma once
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+#include <Engine/Source/AI/HeatmapSystem/HeatmapCommonData.h>
+
+namespace AI
+{
+	// Imprint and interest templates for any curve and radius. Templates are immutable once built and shared,
+	// a template handed out stays valid for as long as the caller holds it, even after it is evicted.
+	class TemplateCache
+	{
+	public:
+		// Builds every curve for cell radii below aPrebuiltSize up front, larger radii are built on first use.
+		void Init(const int aPrebuiltSize);
+		// Same, but takes the baked templates it is given and only builds what is missing.
+		void Init(const int aPrebuiltSize, const std::vector<std::shared_ptr<const HeatTemplate>>& aBaked);
+		void Clear();
+		inline void SetCapacity(const size_t aCapacity) { myCapacity = aCapacity; }
+
+		// Radius in cells, the template is 2 * radius + 1 cells wide. Thread-safe.
+		std::shared_ptr<const HeatTemplate> Get(const FalloffType aCurve, const int aCellRadius);
+
+	private:
+		template<typename Curve>
+		static void Build(const int aCellRadius, HeatTemplate& aTemplate);
+		static std::shared_ptr<const HeatTemplate> Create(const FalloffType aCurve, const int aCellRadius);
+
+		// Read without locking, only written by Init.
+		std::vector<std::vector<std::shared_ptr<const HeatTemplate>>> myPrebuilt;
+
+		std::shared_mutex myMutex;
+		std::unordered_map<unsigned long long, std::shared_ptr<const HeatTemplate>> myTemplates;
+		std::deque<unsigned long long> myInsertOrder;
+		size_t myCapacity = 64;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include "stdafx.h"
+#include "UserRegistry.h"
+#include <Engine/Source/AI/HeatmapSystem/InfluenceComponent.h>
+
+namespace AI
+{
+	UserHandle UserRegistry::Add(InfluenceComponent* aUser, const Vector2i& aCell)
+	{
+		int slot = 0;
+		if (!myFreeSlots.empty())
+		{
+			slot = myFreeSlots.back();
+			myFreeSlots.pop_back();
+		}
+		else
+		{
+			slot = static_cast<int>(mySlotToDense.size());
+			mySlotToDense.push_back(-1);
+			myGenerations.push_back(0);
+		}
+
+		int dense = GetCount();
+		mySlotToDense[slot] = dense;
+		myDenseToSlot.push_back(slot);
+
+		myComponents.push_back(aUser);
+		myTeams.push_back(aUser->myTeam);
+		myDynamic.push_back(aUser->isDynamic ? 1 : 0);
+		myLocations.push_back(aCell);
+		myFutureLocations.push_back(aCell);
+		myScheduledAt.push_back(-1.0f);
+		myFootprintsChanged.push_back(1);
+
+		// Same as GetTemplate, the first imprint of a type is the one that counts.
+		myImprints.resize(myImprints.size() + ImprintStride);
+		myFootprints.resize(myFootprints.size() + ImprintStride);
+		myFutureFootprints.resize(myFutureFootprints.size() + ImprintStride);
+		for (const InfluenceData& imprint : aUser->myImprints)
+		{
+			if (imprint.type == HeatType::COUNT) continue;
+
+			InfluenceData& target = myImprints[dense * ImprintStride + static_cast<int>(imprint.type)];
+			if (target.type == HeatType::COUNT) target = imprint;
+		}
+
+		const Vector3f& position = aUser->myPosition;
+		myPositionX.push_back(position.x);
+		myPositionZ.push_back(position.z);
+		myFuturePositionX.push_back(position.x);
+		myFuturePositionZ.push_back(position.z);
+		myCellX.push_back(aCell.x);
+		myCellY.push_back(aCell.y);
+		myFutureCellX.push_back(aCell.x);
+		myFutureCellY.push_back(aCell.y);
+
+		return { slot, myGenerations[slot], myTag };
+	}
+
+	bool UserRegistry::Remove(const UserHandle& aHandle)
+	{
+		int dense = Find(aHandle);
+		if (dense < 0) return false;
+
+		int last = GetCount() - 1;
+		if (dense != last)
+		{
+			MoveUser(last, dense);
+		}
+
+		myComponents.pop_back();
+		myTeams.pop_back();
+		myDynamic.pop_back();
+		myImprints.resize(myImprints.size() - ImprintStride);
+		myFootprints.resize(myFootprints.size() - ImprintStride);
+		myFutureFootprints.resize(myFutureFootprints.size() - ImprintStride);
+		myLocations.pop_back();
+		myFutureLocations.pop_back();
+		myScheduledAt.pop_back();
+		myFootprintsChanged.pop_back();
+		myPositionX.pop_back();
+		myPositionZ.pop_back();
+		myFuturePositionX.pop_back();
+		myFuturePositionZ.pop_back();
+		myCellX.pop_back();
+		myCellY.pop_back();
+		myFutureCellX.pop_back();
+		myFutureCellY.pop_back();
+		myDenseToSlot.pop_back();
+
+		mySlotToDense[aHandle.slot] = -1;
+		myGenerations[aHandle.slot]++;
+		myFreeSlots.push_back(aHandle.slot);
+
+		return true;
+	}
+
+	void UserRegistry::Clear()
+	{
+		// Generations keep counting, handles from before the clear stay stale.
+		for (int slot = 0; slot < static_cast<int>(mySlotToDense.size()); slot++)
+		{
+			if (mySlotToDense[slot] < 0) continue;
+
+			mySlotToDense[slot] = -1;
+			myGenerations[slot]++;
+			myFreeSlots.push_back(slot);
+		}
+
+		myComponents.clear();
+		myTeams.clear();
+		myDynamic.clear();
+		myImprints.clear();
+		myFootprints.clear();
+		myFutureFootprints.clear();
+		myLocations.clear();
+		myFutureLocations.clear();
+		myScheduledAt.clear();
+		myFootprintsChanged.clear();
+		myPositionX.clear();
+		myPositionZ.clear();
+		myFuturePositionX.clear();
+		myFuturePositionZ.clear();
+		myCellX.clear();
+		myCellY.clear();
+		myFutureCellX.clear();
+		myFutureCellY.clear();
+		myDenseToSlot.clear();
+	}
+
+	int UserRegistry::Find(const UserHandle& aHandle) const
+	{
+		if (aHandle.registry != myTag) return -1;
+		if (aHandle.slot < 0 || aHandle.slot >= static_cast<int>(mySlotToDense.size())) return -1;
+		if (myGenerations[aHandle.slot] != aHandle.generation) return -1;
+
+		return mySlotToDense[aHandle.slot];
+	}
+
+	void UserRegistry::MoveUser(const int aFrom, const int aTo)
+	{
+		myComponents[aTo] = myComponents[aFrom];
+		myTeams[aTo] = myTeams[aFrom];
+		myDynamic[aTo] = myDynamic[aFrom];
+		std::copy(myImprints.begin() + aFrom * ImprintStride, myImprints.begin() + (aFrom + 1) * ImprintStride, myImprints.begin() + aTo * ImprintStride);
+		std::move(myFootprints.begin() + aFrom * ImprintStride, myFootprints.begin() + (aFrom + 1) * ImprintStride, myFootprints.begin() + aTo * ImprintStride);
+		std::move(myFutureFootprints.begin() + aFrom * ImprintStride, myFutureFootprints.begin() + (aFrom + 1) * ImprintStride, myFutureFootprints.begin() + aTo * ImprintStride);
+		myLocations[aTo] = myLocations[aFrom];
+		myFutureLocations[aTo] = myFutureLocations[aFrom];
+		myScheduledAt[aTo] = myScheduledAt[aFrom];
+		myFootprintsChanged[aTo] = myFootprintsChanged[aFrom];
+		myPositionX[aTo] = myPositionX[aFrom];
+		myPositionZ[aTo] = myPositionZ[aFrom];
+		myFuturePositionX[aTo] = myFuturePositionX[aFrom];
+		myFuturePositionZ[aTo] = myFuturePositionZ[aFrom];
+		myCellX[aTo] = myCellX[aFrom];
+		myCellY[aTo] = myCellY[aFrom];
+		myFutureCellX[aTo] = myFutureCellX[aFrom];
+		myFutureCellY[aTo] = myFutureCellY[aFrom];
+
+		int slot = myDenseToSlot[aFrom];
+		myDenseToSlot[aTo] = slot;
+		mySlotToDense[slot] = aTo;
+	}
+
+	const UserSnapshot::User* UserSnapshot::Find(const InfluenceComponent* aUser) const
+	{
+		auto it = std::lower_bound(users.begin(), users.end(), aUser, [](const User& aEntry, const InfluenceComponent* aComponent)
+		{
+			return std::less<const InfluenceComponent*>()(aEntry.component, aComponent);
+		});
+
+		return it != users.end() && it->component == aUser ? &*it : nullptr;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <vector>
+#include <Engine/Source/AI/HeatmapSystem/HeatmapCommonData.h>
+
+namespace AI
+{
+	class InfluenceComponent;
+
+	// Stable reference to a registered user. It goes stale once the user is removed, even if the slot is reused.
+	struct UserHandle
+	{
+		int slot = -1;
+		unsigned int generation = 0;
+		unsigned char registry = 0; // Tag of the registry that issued it, the manager's registries share slot numbers.
+	};
+
+	// Slot map over registered users, stored as parallel arrays. The dense arrays never have holes, so per-tick
+	// passes stream them front to back, and a removal moves the last user into the freed spot.
+	class UserRegistry
+	{
+		friend class HeatmapManager;
+		KE_EDITOR_FRIEND;
+
+	public:
+		// One imprint slot per HeatType, an imprint with type COUNT marks an empty slot.
+		static constexpr int ImprintStride = static_cast<int>(HeatType::COUNT);
+
+		// aTag must be non-zero and differ between registries whose handles can meet, handles of another tag never match.
+		explicit UserRegistry(const unsigned char aTag) : myTag(aTag) {}
+
+		UserHandle Add(InfluenceComponent* aUser, const Vector2i& aCell);
+		bool Remove(const UserHandle& aHandle);
+		void Clear();
+
+		// Dense index of the user, -1 for a stale or empty handle.
+		int Find(const UserHandle& aHandle) const;
+		inline int GetCount() const { return static_cast<int>(myComponents.size()); }
+		inline UserHandle GetHandle(const int aUser) const { return { myDenseToSlot[aUser], myGenerations[myDenseToSlot[aUser]], myTag }; }
+		inline const InfluenceData& GetImprint(const int aUser, const HeatType aType) const
+		{
+			return myImprints[aUser * ImprintStride + static_cast<int>(aType)];
+		}
+		// What an imprint last painted, aFuture picks the second stamp Location imprints put on the future cell.
+		inline Footprint& GetFootprint(const int aUser, const HeatType aType, const bool aFuture = false)
+		{
+			return (aFuture ? myFutureFootprints : myFootprints)[aUser * ImprintStride + static_cast<int>(aType)];
+		}
+		inline const Footprint& GetFootprint(const int aUser, const HeatType aType, const bool aFuture = false) const
+		{
+			return (aFuture ? myFutureFootprints : myFootprints)[aUser * ImprintStride + static_cast<int>(aType)];
+		}
+
+	private:
+		void MoveUser(const int aFrom, const int aTo);
+
+		const unsigned char myTag;
+		std::vector<InfluenceComponent*> myComponents;
+		std::vector<Team> myTeams;
+		std::vector<unsigned char> myDynamic;
+		std::vector<InfluenceData> myImprints;
+		std::vector<Vector2i> myLocations;
+		std::vector<Vector2i> myFutureLocations;
+		std::vector<Footprint> myFootprints;
+		std::vector<Footprint> myFutureFootprints;
+		std::vector<float> myScheduledAt; // When the pending move was seen, negative if none is pending.
+		std::vector<unsigned char> myFootprintsChanged; // Cells or footprints differ from the published UserSnapshot.
+
+		// Synced from the components once per tick on the game thread, repaints never touch the transforms.
+		std::vector<float> myPositionX;
+		std::vector<float> myPositionZ;
+		std::vector<float> myFuturePositionX;
+		std::vector<float> myFuturePositionZ;
+		std::vector<int> myCellX;
+		std::vector<int> myCellY;
+		std::vector<int> myFutureCellX;
+		std::vector<int> myFutureCellY;
+
+		std::vector<int> myDenseToSlot;
+		std::vector<int> mySlotToDense;
+		std::vector<unsigned int> myGenerations;
+		std::vector<int> myFreeSlots;
+	};
+
+	// Cells and recorded footprints of every registered user as of the last publish. Immutable once published, so
+	// queries on any thread read it while registration and repaints change the registries underneath.
+	struct UserSnapshot
+	{
+		struct User
+		{
+			const InfluenceComponent* component = nullptr;
+			Vector2i location;
+			Vector2i futureLocation;
+			bool isStatic = false;
+			// What each imprint type last painted, the future stamps after the current ones. Null when not recorded.
+			std::array<std::shared_ptr<const Footprint>, UserRegistry::ImprintStride * 2> footprints;
+		};
+
+		std::vector<User> users; // Sorted by component.
+
+		const User* Find(const InfluenceComponent* aUser) const;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "stdafx.h"
+#include "WorkerPool.h"
+
+namespace AI
+{
+	WorkerPool::~WorkerPool()
+	{
+		Stop();
+	}
+
+	void WorkerPool::Start(const int aThreadCount)
+	{
+		if (!myThreads.empty()) return;
+
+		myStopping = false;
+		myThreads.reserve(aThreadCount);
+
+		for (int i = 0; i < aThreadCount; i++)
+		{
+			myThreads.emplace_back(&WorkerPool::WorkerLoop, this);
+		}
+	}
+
+	void WorkerPool::Stop()
+	{
+		// Let queued jobs finish so nothing is left running against a destroyed owner.
+		Wait();
+
+		{
+			std::lock_guard<std::mutex> lock(myMutex);
+			myStopping = true;
+		}
+		myJobSignal.notify_all();
+
+		for (auto& thread : myThreads)
+		{
+			if (thread.joinable()) thread.join();
+		}
+
+		myThreads.clear();
+	}
+
+	void WorkerPool::Submit(Job aJob)
+	{
+		myPendingJobs.fetch_add(1, std::memory_order_acq_rel);
+
+		// Without workers the job runs inline, which keeps single threaded builds working.
+		if (myThreads.empty())
+		{
+			aJob();
+			myPendingJobs.fetch_sub(1, std::memory_order_acq_rel);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(myMutex);
+			myJobs.push_back(std::move(aJob));
+		}
+		myJobSignal.notify_one();
+	}
+
+	void WorkerPool::Wait()
+	{
+		std::unique_lock<std::mutex> lock(myMutex);
+		myIdleSignal.wait(lock, [this]() { return myPendingJobs.load(std::memory_order_acquire) == 0; });
+	}
+
+	void WorkerPool::ParallelFor(const int aCount, const std::function<void(int)>& aTask)
+	{
+		if (aCount <= 0) return;
+
+		struct Batch
+		{
+			std::atomic<int> next = 0;
+			std::atomic<int> done = 0;
+		};
+
+		// Helpers that start after the caller returned only touch the batch, never the task.
+		auto batch = std::make_shared<Batch>();
+		auto runTasks = [batch, aCount, &aTask]()
+		{
+			int index;
+			while ((index = batch->next.fetch_add(1, std::memory_order_relaxed)) < aCount)
+			{
+				aTask(index);
+				batch->done.fetch_add(1, std::memory_order_release);
+			}
+		};
+
+		int helperCount = std::min(GetThreadCount(), aCount - 1);
+		for (int i = 0; i < helperCount; i++)
+		{
+			Submit(runTasks);
+		}
+
+		// The caller takes tasks as well, so this is safe to call from inside a job on a busy pool.
+		runTasks();
+
+		while (batch->done.load(std::memory_order_acquire) < aCount)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	void WorkerPool::WorkerLoop()
+	{
+		while (true)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(myMutex);
+				myJobSignal.wait(lock, [this]() { return myStopping || !myJobs.empty(); });
+
+				if (myJobs.empty()) return;
+
+				job = std::move(myJobs.front());
+				myJobs.pop_front();
+			}
+
+			job();
+
+			if (myPendingJobs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				// Take the lock so a waiter can't miss the wake-up between its check and its wait.
+				std::lock_guard<std::mutex> lock(myMutex);
+				myIdleSignal.notify_all();
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace AI
+{
+	// Long-lived worker threads that execute heatmap jobs.
+	// Threads are created once on Start and joined on Stop or destruction.
+	class WorkerPool
+	{
+	public:
+		using Job = std::function<void()>;
+
+		WorkerPool() = default;
+		~WorkerPool();
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+
+		void Start(const int aThreadCount);
+		void Stop();
+		void Submit(Job aJob);
+		void Wait();
+		void ParallelFor(const int aCount, const std::function<void(int)>& aTask);
+
+		inline bool IsBusy() const { return myPendingJobs.load(std::memory_order_acquire) > 0; }
+		inline int GetThreadCount() const { return static_cast<int>(myThreads.size()); }
+
+	private:
+		void WorkerLoop();
+
+		std::vector<std::thread> myThreads;
+		std::deque<Job> myJobs;
+		std::mutex myMutex;
+		std::condition_variable myJobSignal;
+		std::condition_variable myIdleSignal;
+		std::atomic<int> myPendingJobs = 0;
+		bool myStopping = false;
+	};
+}
\ No newline at end of file
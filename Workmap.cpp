@@ -3,6 +3,7 @@
 #include <Engine/Source/AI/HeatmapSystem/HeatmapCommonData.h>
 #include <Engine/Source/AI/HeatmapSystem/HeatmapManager.h>
 #include <Engine/Source/AI/HeatmapSystem/InfluenceComponent.h>
+#include <Engine/Source/AI/HeatmapSystem/HeatmapSimd.h>
 
 #include <Engine/Source/Graphics/DebugRenderer.h>
 #include <Engine/Source/Graphics/Sprite/SpriteManager.h>
@@ -16,9 +17,8 @@ namespace AI
 		myMin = aManager->myMin;
 		myMax = aManager->myMax;
 		myWorldGridSize = aManager->myGridSize;
+		myReachMasks = false;
 
-		KE::TextureLoader* textureLoader = KE_GLOBAL::blackboard.Get<KE::TextureLoader>("textureLoader");
-		myDebug.myHeatSpriteBatch.myData.myTexture = textureLoader->GetTextureFromPath("Data/EngineAssets/KEDefault_c.dds");
 		myDebug.spriteMatrix(2, 2) = 0.0f;
 		myDebug.spriteMatrix(2, 3) = 1.0f;
 		myDebug.spriteMatrix(3, 3) = 0.0;
@@ -26,19 +26,12 @@ namespace AI
 
 	}
 
-	void Workmap::RandomizeTraverseOrder()
-	{
-		// Randomize the order of how BFS traverse.
-		for (int i = static_cast<int>(myTraverseOrder.size() - 1); i > 0; --i) {
-			int j = std::rand() % (i + 1);
-			std::swap(myTraverseOrder[i], myTraverseOrder[j]);
-		}
-	}
-
 	void Workmap::Init(const Vector2i aGridSize, Vector2i aAnchor, const Vector2f aMin, const Vector2f aMax, const float aCellSize)
 	{
-		myValues.clear();
-		myValues.resize(aGridSize.x * aGridSize.y);
+		// Keeps the capacity from earlier queries, pooled workmaps don't reallocate once warmed up.
+		myValues.assign(aGridSize.x * aGridSize.y, 0.0f);
+		myOperations.clear();
+		myHasValues = false;
 
 		myGridSize = aGridSize;
 		myWorldOrigin = aAnchor;
@@ -54,10 +47,21 @@ namespace AI
 		myBoundsMax.y = (myGridSize.y - 1) - abs(std::min(0, myManager->myGridSize.y - (myWorldOrigin.y + halfSize + 1)));
 	}
 
+	void Workmap::InitDebug()
+	{
+		if (myDebug.hasTexture) return;
+
+		KE::TextureLoader* textureLoader = KE_GLOBAL::blackboard.Get<KE::TextureLoader>("textureLoader");
+		myDebug.myHeatSpriteBatch.myData.myTexture = textureLoader->GetTextureFromPath("Data/EngineAssets/KEDefault_c.dds");
+		myDebug.hasTexture = true;
+	}
+
 	void Workmap::DebugDraw(int aID)
 	{
 		if (aID != myDebug.debugUserID) return;
 
+		InitDebug();
+
 		KE::DebugRenderer* dbg = KE_GLOBAL::blackboard.Get<KE::DebugRenderer>("debugRenderer");
 
 		// Draw a Square around the workmap
@@ -120,148 +124,247 @@ namespace AI
 	{
 		if (Heatmap* map = myManager->GetHeatmap(aTeam, aType))
 		{
-			ON_THREAD(map->LockMutex())
-
-				// Defines the bounds of the heat template in the world grid.
-				Vector2i boundsMin = {
-					abs(std::min(0, myWorldOrigin.x - myScanRadius)),
-					abs(std::min(0, myWorldOrigin.y - myScanRadius)) };
-
-			Vector2i boundsMax = {
-				abs(std::max(0, (myWorldOrigin.x + myScanRadius) - map->myGridSize.x + 1)),
-				abs(std::max(0, (myWorldOrigin.y + myScanRadius) - map->myGridSize.y + 1)) };
-
-			Vector2i mapCoord = {
-				myWorldOrigin.x - myScanRadius,
-				myWorldOrigin.y - myScanRadius
-			};
-
-			for (int i = boundsMin.y; i < myGridSize.y - boundsMax.y; i++)
-			{
-				int heatRow = mapCoord.y + i;
-
-				for (int j = boundsMin.x; j < myGridSize.x - boundsMax.x; j++)
-				{
-					int heatCol = mapCoord.x + j;
-
-					int workmapIndex = i * myGridSize.x + j;
-					int heatmapIndex = heatRow * map->myGridSize.x + heatCol;
-
-					myValues[workmapIndex] += map->myValues[heatmapIndex] * aInterest;
-				}
-			}
-
-			ON_THREAD(map->UnlockMutex();)
+			// Reads go to the published snapshot, painting never blocks a query.
+			myOperations.push_back({ Operation::Kind::Add, map->GetSnapshot(), aInterest });
 		}
 	}
 	void Workmap::Subtract(Team aTeam, HeatType aType, const float aScalar)
 	{
 		if (Heatmap* map = myManager->GetHeatmap(aTeam, aType))
 		{
-			for (int i = 0; i < map->myValues.size(); ++i)
-			{
-				myValues[i] -= map->myValues[i] * aScalar;
-			}
+			myOperations.push_back({ Operation::Kind::Add, map->GetSnapshot(), -aScalar });
 		}
 	}
 	void Workmap::Multiply(Team aTeam, HeatType aType, const float aScalar)
 	{
 		if (Heatmap* map = myManager->GetHeatmap(aTeam, aType))
 		{
-			for (int i = 0; i < map->myValues.size(); ++i)
-			{
-				myValues[i] -= map->myValues[i] * aScalar;
-			}
+			myOperations.push_back({ Operation::Kind::Multiply, map->GetSnapshot(), aScalar });
 		}
 	}
 	void Workmap::Normalize()
 	{
-		float highestValue = 0.0f;
-		for (int i = 0; i < myValues.size(); ++i)
-		{
-			if (highestValue < myValues[i]) {
-				highestValue = myValues[i];
-			}
-		}
-
-		if (highestValue == 0) { return; }
-
-		for (int i = 0; i < myValues.size(); ++i)
+		myOperations.push_back({ Operation::Kind::Normalize, nullptr, 1.0f });
+	}
+	void Workmap::Invert()
+	{
+		if (!myOperations.empty() && myOperations.back().kind == Operation::Kind::Scale)
 		{
-			myValues[i] /= highestValue;
+			myOperations.back().scalar *= -1.0f;
+			return;
 		}
+		myOperations.push_back({ Operation::Kind::Scale, nullptr, -1.0f });
 	}
-	void Workmap::Invert()
+
+	void Workmap::Evaluate()
 	{
-		for (int i = 0; i < myValues.size(); i++)
+		if (myOperations.empty()) return;
+
+		// Cells outside the world never receive layer values and stay zero through every operation,
+		// so only the clipped window is streamed.
+		int halfSize = myGridSize.x / 2;
+		int rowLength = myBoundsMax.x - myBoundsMin.x + 1;
+		Vector2i mapCoord = { myWorldOrigin.x - halfSize, myWorldOrigin.y - halfSize };
+
+		// Operations between two normalizes run fused band by band while the band is in cache. A normalize
+		// reduces the max during that pass and its scale is applied as the first step of the next pass.
+		float pendingScale = 1.0f;
+		size_t first = 0;
+		bool finalPass = false;
+
+		while (!finalPass)
 		{
-			myValues[i] *= -1;
+			size_t last = first;
+			while (last < myOperations.size() && myOperations[last].kind != Operation::Kind::Normalize) last++;
+
+			bool normalize = last < myOperations.size();
+			finalPass = !normalize;
+			if (finalPass && first == last && pendingScale == 1.0f) break;
+
+			float highestValue = 0.0f;
+
+			// Bands of rows follow the layers' tile rows, so a sparse layer is read in one block per tile and a
+			// dense one in a single block. A band is still small enough to stay in cache through all operations.
+			for (int bandBegin = myBoundsMin.y; bandBegin <= myBoundsMax.y;)
+			{
+				int mapRow = mapCoord.y + bandBegin;
+				int mapCol = mapCoord.x + myBoundsMin.x;
+				int bandRows = std::min(myBoundsMax.y + 1 - bandBegin, HeatmapSnapshot::TileSize - mapRow % HeatmapSnapshot::TileSize);
+				float* band = &myValues[bandBegin * myGridSize.x + myBoundsMin.x];
+
+				if (pendingScale != 1.0f)
+				{
+					for (int row = 0; row < bandRows; row++) simd::Scale(band + row * myGridSize.x, pendingScale, rowLength);
+				}
+
+				for (size_t op = first; op < last; op++)
+				{
+					const Operation& operation = myOperations[op];
+					switch (operation.kind)
+					{
+					case Operation::Kind::Add:
+						// Missing tiles of sparse layers add nothing and zero what they multiply.
+						if (operation.layer->IsQuantized())
+						{
+							for (int row = 0; row < bandRows; row++)
+							{
+								simd::AddScaledQuantized(band + row * myGridSize.x, operation.layer->quantized.data() + (mapRow + row) * operation.layer->width + mapCol,
+									operation.scalar * operation.layer->quantizeStep, rowLength);
+							}
+							break;
+						}
+						operation.layer->ForEachBlock(mapRow, mapRow + bandRows, mapCol, mapCol + rowLength, [&](const float* aLayer, int aStride, int aRow, int aRows, int aCol, int aCount) {
+							if (aLayer) simd::AddScaledBlock(band + (aRow - mapRow) * myGridSize.x + (aCol - mapCol), myGridSize.x, aLayer, aStride, operation.scalar, aCount, aRows);
+						});
+						break;
+					case Operation::Kind::Multiply:
+						if (operation.layer->IsQuantized())
+						{
+							for (int row = 0; row < bandRows; row++)
+							{
+								simd::MultiplyScaledQuantized(band + row * myGridSize.x, operation.layer->quantized.data() + (mapRow + row) * operation.layer->width + mapCol,
+									operation.scalar * operation.layer->quantizeStep, rowLength);
+							}
+							break;
+						}
+						operation.layer->ForEachBlock(mapRow, mapRow + bandRows, mapCol, mapCol + rowLength, [&](const float* aLayer, int aStride, int aRow, int aRows, int aCol, int aCount) {
+							float* values = band + (aRow - mapRow) * myGridSize.x + (aCol - mapCol);
+							if (aLayer)
+							{
+								simd::MultiplyScaledBlock(values, myGridSize.x, aLayer, aStride, operation.scalar, aCount, aRows);
+								return;
+							}
+							for (int row = 0; row < aRows; row++) std::fill(values + row * myGridSize.x, values + row * myGridSize.x + aCount, 0.0f);
+						});
+						break;
+					case Operation::Kind::Scale:
+						for (int row = 0; row < bandRows; row++) simd::Scale(band + row * myGridSize.x, operation.scalar, rowLength);
+						break;
+					default:
+						break;
+					}
+				}
+
+				if (normalize)
+				{
+					for (int row = 0; row < bandRows; row++) highestValue = std::max(highestValue, simd::Max(band + row * myGridSize.x, rowLength));
+				}
+
+				bandBegin += bandRows;
+			}
+
+			pendingScale = normalize && highestValue != 0.0f ? 1.0f / highestValue : 1.0f;
+			first = last + 1;
 		}
+
+		// Drops the snapshot references so the layers can recycle them.
+		myOperations.clear();
+		myHasValues = true;
 	}
 
 #pragma endregion
 
 	void Workmap::ExcludeUserInfluence(const InfluenceComponent& aUser, HeatType aType)
 	{
+		// Painting goes straight into the values, everything recorded before it has to land first.
+		Evaluate();
+		myHasValues = true;
+
+		// Cells and footprints from one published snapshot, repaints may be rewriting the live ones.
 		const InfluenceData& data = *aUser.GetTemplate(aType);
-		Vector2i localOrigin = { myGridSize.x / 2, myGridSize.y / 2 };
+		std::shared_ptr<const UserSnapshot> users = myManager->GetUserSnapshot();
+		const UserSnapshot::User* user = users ? users->Find(&aUser) : nullptr;
+		if (!user) return;
+
+		// World cell + offset = local cell, the window center is the workmap's world origin.
+		Vector2i offset = Vector2i(myGridSize.x / 2, myGridSize.y / 2) - myWorldOrigin;
+
+		// Exactly what the user painted when the footprint is known, a flood fill at the user's cells otherwise.
+		auto exclude = [&](const Vector2i& aCell, float aAmount, bool aFuture)
+		{
+			if (const Footprint* footprint = user->footprints[(aFuture ? UserRegistry::ImprintStride : 0) + static_cast<int>(aType)].get())
+			{
+				ExcludeFootprint(*footprint, offset);
+			}
+			else
+			{
+				Workmap::FloodFillInfluence(aCell + offset, data, -aAmount);
+			}
+		};
 
 		if (aType == HeatType::Location)
 		{
-			Vector2i futureLocalOrigin = localOrigin + (aUser.futureLocation - aUser.location);
-			Workmap::FloodFillInfluence(localOrigin, data, -0.5f);
-			Workmap::FloodFillInfluence(futureLocalOrigin, data, -0.5f);
+			exclude(user->location, 0.5f, false);
+			exclude(user->futureLocation, 0.5f, true);
 		}
 		else
 		{
-			Workmap::FloodFillInfluence(localOrigin, data, -1.0f);
+			exclude(user->location, data.maxValue, false);
 		}
 	}
 
-	Vector3f Workmap::GetHighestPoint()
+	void Workmap::ExcludeFootprint(const Footprint& aFootprint, const Vector2i& aOffset)
 	{
-		DEBUG_ONLY(
-			myDebug.interestValues.resize(myValues.size());
-			myDebug.templateValues.resize(myValues.size());
-			std::fill(myDebug.interestValues.begin(), myDebug.interestValues.end(), 0.0f);
-			std::fill(myDebug.templateValues.begin(), myDebug.templateValues.end(), 0.0f);
-		);
+		const float* values = aFootprint.values.data();
 
-		HeatTemplate& heatTemplate = myManager->GetInterestTemplate(myScanRadius);
-		std::queue<std::tuple<Vector2i, Vector2i>> bfsQueue;
-		std::set<int> visited;
+		for (const Footprint::Run& run : aFootprint.runs)
+		{
+			// Runs never wrap a row, clip each one to the part of the window that lies inside the world.
+			int row = run.index / myWorldGridSize.x + aOffset.y;
+			int colBegin = run.index % myWorldGridSize.x + aOffset.x;
+			int first = std::max(colBegin, myBoundsMin.x);
+			int last = std::min(colBegin + run.length - 1, myBoundsMax.x);
+
+			if (row >= myBoundsMin.y && row <= myBoundsMax.y && first <= last)
+			{
+				simd::AddScaled(myValues.data() + row * myGridSize.x + first, values + (first - colBegin), -1.0f, last - first + 1);
+			}
 
-		RandomizeTraverseOrder();
+			values += run.length;
+		}
+	}
 
-		int halfSize = static_cast<int>(myGridSize.x / 2);
+	void Workmap::BuildReachableWeights(const HeatTemplate& aTemplate)
+	{
+		myWeights.assign(myValues.size(), 0.0f);
 
-		int worldStartIndex = myWorldOrigin.y * myWorldGridSize.x + myWorldOrigin.x;
+		int halfSize = static_cast<int>(myGridSize.x / 2);
 		int localStartIndex = halfSize * myGridSize.x + halfSize;
 
-		int bestCell = INT_MIN;
-		float highestValue = INT_MIN;
+		// The origin always counts and is never scaled by the interest curve.
+		myWeights[localStartIndex] = 1.0f;
 
-		if (myValues[localStartIndex] != 0)
+		// The window lines up with the template cell for cell, so a cached reach mask is the weight mask as is.
+		std::shared_ptr<const ReachMask> mask = myManager->GetReachMask(myWorldOrigin, halfSize);
+		if (mask)
 		{
-			highestValue = myValues[localStartIndex];
-			bestCell = localStartIndex;
+			for (int row = 0; row < myGridSize.y; row++)
+			{
+				for (int col = mask->rowBegin[row]; col <= mask->rowEnd[row]; col++)
+				{
+					int localIndex = row * myGridSize.x + col;
+					if (mask->steps[localIndex] > 1) myWeights[localIndex] = aTemplate.values[localIndex];
+				}
+			}
+
+			return;
 		}
 
-		bfsQueue.push({ myWorldOrigin, {halfSize, halfSize} });
-		visited.insert(worldStartIndex);
+		FloodFillScratch& scratch = HeatmapManager::GetFloodFillScratch();
+		scratch.Begin(myGridSize.x);
+		scratch.Visit(localStartIndex);
+		scratch.Push({ myWorldOrigin, { halfSize, halfSize }, 0 });
 
-		while (!bfsQueue.empty())
-		{
-			Vector2i worldCoord, templateCoord;
-			Vector2i nextWorldCoord, nextLocalCoord;
+		std::array<Vector2i, 4> directions = { Vector2i(0, 1), Vector2i(-1, 0), Vector2i(0, -1), Vector2i(1, 0) };
 
-			std::tie(worldCoord, templateCoord) = bfsQueue.front();
-			bfsQueue.pop();
+		while (!scratch.Empty())
+		{
+			const FloodFillNode node = scratch.Pop();
 
-			for (const auto& direction : myTraverseOrder)
+			for (const auto& direction : directions)
 			{
-				nextWorldCoord = worldCoord + direction;
-				nextLocalCoord = templateCoord + direction;
+				Vector2i nextWorldCoord = node.coord + direction;
+				Vector2i nextLocalCoord = node.templateCoord + direction;
 
 				if (nextLocalCoord.x < myBoundsMin.x || nextLocalCoord.x > myBoundsMax.x ||
 					nextLocalCoord.y < myBoundsMin.y || nextLocalCoord.y > myBoundsMax.y) {
@@ -271,31 +374,179 @@ namespace AI
 				int worldIndex = nextWorldCoord.y * myWorldGridSize.x + nextWorldCoord.x;
 				int localIndex = nextLocalCoord.y * myGridSize.x + nextLocalCoord.x;
 
-				if (!myValidCells->at(worldIndex)) continue;
+				if (!(*myValidCells)[worldIndex]) continue;
 
-				if (visited.find(localIndex) == visited.end())
+				if (scratch.Visit(localIndex))
 				{
-					bfsQueue.push({ nextWorldCoord, nextLocalCoord });
-					visited.insert(localIndex);
+					myWeights[localIndex] = aTemplate.values[localIndex];
+					scratch.Push({ nextWorldCoord, nextLocalCoord, node.distance + 1 });
+				}
+			}
+		}
+	}
+
+	Vector3f Workmap::GetHighestPoint()
+	{
+		int bestCell = FindHighestCell();
+		if (bestCell < 0) return myUserPos;
+
+		return GetPosByIndex(bestCell);
+	}
+	int Workmap::FindHighestCell()
+	{
+		int boundedCell = -1;
+		if (FindHighestCellBounded(boundedCell)) return boundedCell;
+
+		Evaluate();
+
+		std::shared_ptr<const HeatTemplate> heatTemplate = myManager->GetInterestTemplate(myScanRadius);
+		BuildReachableWeights(*heatTemplate);
+
+		// Unreachable cells carry a zero weight, so one branch-free pass over the window finds the best value.
+		int cellCount = static_cast<int>(myValues.size());
+		float highestValue = simd::MaxNonZeroProduct(myValues.data(), myWeights.data(), cellCount);
+
+		DEBUG_ONLY(
+			myDebug.interestValues.resize(myValues.size());
+			myDebug.templateValues.resize(myValues.size());
+			for (int i = 0; i < cellCount; i++)
+			{
+				float value = myValues[i] * myWeights[i];
+				myDebug.interestValues[i] = value;
+				myDebug.templateValues[i] = value != 0 ? myWeights[i] : 0.0f;
+			}
+		);
 
-					float value = myValues[localIndex] * heatTemplate.values[localIndex];
-					if (value == 0) continue;
+		if (highestValue == -std::numeric_limits<float>::infinity()) return -1;
 
-					if (value > highestValue)
+		// Equal cells are resolved by the lowest hash, seeded by the query origin, so ties are stable per location.
+		unsigned int seed = HashCell(static_cast<unsigned int>(myWorldOrigin.y * myWorldGridSize.x + myWorldOrigin.x), 0x9E3779B9u);
+		unsigned int bestHash = UINT_MAX;
+		int bestCell = -1;
+
+		for (int i = 0; i < cellCount; i++)
+		{
+			if (myValues[i] * myWeights[i] != highestValue) continue;
+
+			unsigned int hash = HashCell(static_cast<unsigned int>(i), seed);
+			if (bestCell < 0 || hash < bestHash)
+			{
+				bestHash = hash;
+				bestCell = i;
+			}
+		}
+
+		return bestCell;
+	}
+
+	bool Workmap::FindHighestCellBounded(int& aOutCell)
+	{
+		if (myOperations.empty() || myHasValues) return false;
+
+		// Fold the recipe into one weight per layer. A trailing Normalize only scales everything by a positive
+		// factor and can't move the best cell, but operations after one see the window max of what came before and
+		// a multiply makes the value non-linear in the layers, both rule the search out.
+		myBoundTerms.clear();
+		bool normalized = false;
+		for (const Operation& operation : myOperations)
+		{
+			if (normalized && operation.kind != Operation::Kind::Normalize) return false;
+
+			switch (operation.kind)
+			{
+			case Operation::Kind::Add:
+				if (operation.layer->maxPyramid.empty()) return false;
+				myBoundTerms.push_back({ operation.layer.get(), operation.scalar });
+				break;
+			case Operation::Kind::Scale:
+				for (auto& term : myBoundTerms) term.second *= operation.scalar;
+				break;
+			case Operation::Kind::Multiply:
+				return false;
+			case Operation::Kind::Normalize:
+				normalized = true;
+				break;
+			}
+		}
+
+		std::shared_ptr<const HeatTemplate> heatTemplate = myManager->GetInterestTemplate(myScanRadius);
+		BuildReachableWeights(*heatTemplate);
+
+		int halfSize = myGridSize.x / 2;
+		Vector2i mapCoord = { myWorldOrigin.x - halfSize, myWorldOrigin.y - halfSize };
+		Vector2i cellMin = mapCoord + myBoundsMin;
+		Vector2i cellMax = mapCoord + myBoundsMax;
+		int tilesPerRow = (myWorldGridSize.x + TileSize - 1) / TileSize;
+
+		// Upper bound of every world tile under the window. Interest weights never exceed 1, so a tile whose layer
+		// bound is negative can still get arbitrarily close to zero and is bounded by zero instead.
+		myTileBounds.clear();
+		for (int tileY = cellMin.y / TileSize; tileY <= cellMax.y / TileSize; tileY++)
+		{
+			for (int tileX = cellMin.x / TileSize; tileX <= cellMax.x / TileSize; tileX++)
+			{
+				int tile = tileY * tilesPerRow + tileX;
+				float bound = 0.0f;
+				for (const auto& term : myBoundTerms)
+				{
+					bound += term.second * (term.second > 0.0f ? term.first->maxPyramid[0][tile] : term.first->minPyramid[0][tile]);
+				}
+
+				myTileBounds.push_back({ std::max(0.0f, bound), tile });
+			}
+		}
+		std::sort(myTileBounds.begin(), myTileBounds.end(), [](const auto& aLeft, const auto& aRight) { return aLeft.first > aRight.first; });
+
+		unsigned int seed = HashCell(static_cast<unsigned int>(myWorldOrigin.y * myWorldGridSize.x + myWorldOrigin.x), 0x9E3779B9u);
+		float highestValue = -std::numeric_limits<float>::infinity();
+		unsigned int bestHash = UINT_MAX;
+		int bestCell = -1;
+
+		for (const auto& tileBound : myTileBounds)
+		{
+			// Sorted by bound, once a tile can't reach the best value none of the rest can. The slack covers the
+			// folded weights rounding differently from the recorded operations.
+			if (tileBound.first + std::abs(tileBound.first) * 1e-5f < highestValue) break;
+
+			int tileX = tileBound.second % tilesPerRow;
+			int tileY = tileBound.second / tilesPerRow;
+			int rowBegin = std::max(cellMin.y, tileY * TileSize);
+			int rowEnd = std::min(cellMax.y, (tileY + 1) * TileSize - 1);
+			int colBegin = std::max(cellMin.x, tileX * TileSize);
+			int colEnd = std::min(cellMax.x, (tileX + 1) * TileSize - 1);
+
+			for (int row = rowBegin; row <= rowEnd; row++)
+			{
+				for (int col = colBegin; col <= colEnd; col++)
+				{
+					int localIndex = (row - mapCoord.y) * myGridSize.x + (col - mapCoord.x);
+					if (myWeights[localIndex] == 0.0f) continue;
+
+					// Same operation order as Evaluate, so the value matches the fused pass.
+					float value = 0.0f;
+					for (const Operation& operation : myOperations)
+					{
+						if (operation.kind == Operation::Kind::Add) value += operation.layer->GetValue(row, col) * operation.scalar;
+						else if (operation.kind == Operation::Kind::Scale) value *= operation.scalar;
+					}
+
+					value *= myWeights[localIndex];
+					if (value == 0.0f || value < highestValue) continue;
+
+					unsigned int hash = HashCell(static_cast<unsigned int>(localIndex), seed);
+					if (value > highestValue || hash < bestHash)
 					{
 						highestValue = value;
+						bestHash = hash;
 						bestCell = localIndex;
 					}
-
-					DEBUG_ONLY(myDebug.interestValues[localIndex] = (myValues[localIndex] * heatTemplate.values[localIndex]);)
-					DEBUG_ONLY(myDebug.templateValues[localIndex] = heatTemplate.values[localIndex];)
 				}
 			}
 		}
 
-		if (bestCell == INT_MIN) return myUserPos;
-
-		return GetPosByIndex(bestCell);
+		myOperations.clear();
+		aOutCell = bestCell;
+		return true;
 	}
 
 }
\ No newline at end of file
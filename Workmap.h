@@ -24,6 +24,7 @@ namespace AI
 		int debugUserID = 0;
 		Vector3f highestPoint;
 		Vector4f templateBox[4] = {};
+		bool hasTexture = false;
 	};
 
 	class Workmap : public Heatmap
@@ -40,18 +41,60 @@ namespace AI
 		void Multiply(Team aTeam, HeatType aType, const float aScalar = 1.0f);
 		void Normalize();
 		void Invert();
+		// Operations above are recorded and run here in one fused pass, GetHighestPoint evaluates on its own.
+		void Evaluate();
 		void DebugDraw(int aID = INT_MIN);
+		// Fetches the debug texture, game thread only. Not done on construction since pooled workmaps are created
+		// on whichever thread first runs short of them.
+		void InitDebug();
 
 		void ExcludeUserInfluence(const InfluenceComponent& aUser, HeatType aType);
 		Vector3f GetHighestPoint();
 
 	private:
-		void RandomizeTraverseOrder();
+		struct Operation
+		{
+			enum class Kind { Add, Multiply, Scale, Normalize };
+			Kind kind;
+			std::shared_ptr<const HeatmapSnapshot> layer;
+			float scalar;
+		};
+
+		// Local index of the best reachable cell, -1 when every reachable cell is zero.
+		int FindHighestCell();
+		// Branch-and-bound over the layers' tile pyramids, only for recipes that are a weighted sum of layers.
+		// Returns false when the recipe or the layers don't allow it and the window has to be evaluated.
+		bool FindHighestCellBounded(int& aOutCell);
+		inline int GetWorldIndex(const int aLocalIndex) const
+		{
+			int halfSize = myGridSize.x / 2;
+			int row = myWorldOrigin.y - halfSize + aLocalIndex / myGridSize.x;
+			int col = myWorldOrigin.x - halfSize + aLocalIndex % myGridSize.x;
+			return row * myWorldGridSize.x + col;
+		}
+
+		// Subtracts a layer footprint, shifted into the window by aOffset.
+		void ExcludeFootprint(const Footprint& aFootprint, const Vector2i& aOffset);
+
+		// Interest template weights for cells reachable from the origin, zero everywhere else.
+		void BuildReachableWeights(const HeatTemplate& aTemplate);
+		static inline unsigned int HashCell(unsigned int aCell, unsigned int aSeed)
+		{
+			unsigned int hash = (aCell ^ aSeed) * 0x85EBCA6Bu;
+			hash ^= hash >> 13;
+			hash *= 0xC2B2AE35u;
+			return hash ^ (hash >> 16);
+		}
+
 		void Init(const Vector2i aGridSize, Vector2i aAnchor, const Vector2f aMin, const Vector2f aMax, const float aCellSize) override;
 		Vector2i myWorldGridSize; // Need this to check if a local cell is valid.
 		WorkmapDebugData myDebug;
 		int myScanRadius = 0;
 		Vector3f myUserPos;
-		std::array<Vector2i, 4> myTraverseOrder = { Vector2i(0,  1), Vector2i(-1,  0), Vector2i(0, -1), Vector2i(1,  0) };
+		std::vector<float> myWeights;
+		std::vector<Operation> myOperations;
+		bool myHasValues = false; // Set once anything is written to myValues, the bounded search only reads layers.
+		std::vector<std::pair<const HeatmapSnapshot*, float>> myBoundTerms;
+		std::vector<std::pair<float, int>> myTileBounds;
 	};
 }
\ No newline at end of file
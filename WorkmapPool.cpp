@@ -0,0 +1,76 @@
+#include "stdafx.h"
+#include "WorkmapPool.h"
+#include <Engine/Source/AI/HeatmapSystem/Workmap.h>
+
+namespace AI
+{
+	WorkmapHandle::WorkmapHandle(WorkmapHandle&& aOther) noexcept :
+		myPool(aOther.myPool), myWorkmap(aOther.myWorkmap)
+	{
+		aOther.myPool = nullptr;
+		aOther.myWorkmap = nullptr;
+	}
+
+	WorkmapHandle& WorkmapHandle::operator=(WorkmapHandle&& aOther) noexcept
+	{
+		if (this != &aOther)
+		{
+			Release();
+			myPool = aOther.myPool;
+			myWorkmap = aOther.myWorkmap;
+			aOther.myPool = nullptr;
+			aOther.myWorkmap = nullptr;
+		}
+
+		return *this;
+	}
+
+	void WorkmapHandle::Release()
+	{
+		if (myPool && myWorkmap)
+		{
+			myPool->Release(myWorkmap);
+		}
+
+		myPool = nullptr;
+		myWorkmap = nullptr;
+	}
+
+	WorkmapPool::WorkmapPool(HeatmapManager* aManager) : myManager(aManager)
+	{
+
+	}
+
+	WorkmapPool::~WorkmapPool()
+	{
+
+	}
+
+	Workmap* WorkmapPool::Acquire()
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+
+		if (myFreeWorkmaps.empty())
+		{
+			myWorkmaps.push_back(std::make_unique<Workmap>(myManager));
+			return myWorkmaps.back().get();
+		}
+
+		Workmap* workmap = myFreeWorkmaps.back();
+		myFreeWorkmaps.pop_back();
+
+		return workmap;
+	}
+
+	void WorkmapPool::Release(Workmap* aWorkmap)
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		myFreeWorkmaps.push_back(aWorkmap);
+	}
+
+	int WorkmapPool::GetSize()
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		return static_cast<int>(myWorkmaps.size());
+	}
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace AI
+{
+	class HeatmapManager;
+	class Workmap;
+	class WorkmapPool;
+
+	// A checked out workmap. It goes back to its pool when the handle is destroyed or released.
+	class WorkmapHandle
+	{
+	public:
+		WorkmapHandle() = default;
+		WorkmapHandle(WorkmapPool* aPool, Workmap* aWorkmap) : myPool(aPool), myWorkmap(aWorkmap) {}
+		~WorkmapHandle() { Release(); }
+
+		WorkmapHandle(const WorkmapHandle&) = delete;
+		WorkmapHandle& operator=(const WorkmapHandle&) = delete;
+		WorkmapHandle(WorkmapHandle&& aOther) noexcept;
+		WorkmapHandle& operator=(WorkmapHandle&& aOther) noexcept;
+
+		void Release();
+
+		inline Workmap* Get() const { return myWorkmap; }
+		inline Workmap* operator->() const { return myWorkmap; }
+		inline Workmap& operator*() const { return *myWorkmap; }
+		inline explicit operator bool() const { return myWorkmap != nullptr; }
+
+	private:
+		WorkmapPool* myPool = nullptr;
+		Workmap* myWorkmap = nullptr;
+	};
+
+	// Owns every workmap handed out to queries. Released workmaps keep their buffers,
+	// so steady-state queries reuse memory instead of allocating per frame.
+	class WorkmapPool
+	{
+	public:
+		WorkmapPool(HeatmapManager* aManager);
+		~WorkmapPool();
+
+		Workmap* Acquire();
+		void Release(Workmap* aWorkmap);
+		int GetSize();
+
+	private:
+		HeatmapManager* myManager = nullptr;
+		std::mutex myMutex;
+		std::vector<std::unique_ptr<Workmap>> myWorkmaps;
+		std::vector<Workmap*> myFreeWorkmaps;
+	};
+}
\ No newline at end of file